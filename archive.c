@@ -0,0 +1,192 @@
+#include "bundle.h"
+#include "session.h"
+#include "store.h"
+#include "util.h"
+
+// C99
+#include <inttypes.h>
+
+// C90
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// number of imported checkpoints committed in each transaction
+#define IMPORT_BATCH_SIZE 4096
+
+static int export(const char* db_filename, const char* bundle_filename) {
+    /* Stream all checkpoints of a database into a new bundle, along with the
+     * rest of their rows and the validation table */
+    struct store* store = store_open_existing(db_filename, 1);
+    if (store == NULL) {
+        return -1;
+    }
+    // the bundle records the puzzle, so that it can be used on its own
+    struct session* session = session_new();
+    if (session == NULL || session_parameters(session, store) < 0) {
+        if (session != NULL) {
+            session_delete(session);
+        }
+        store_close(store);
+        return -1;
+    }
+    struct bundle_writer* writer = bundle_create(
+        bundle_filename, mpz_sizeinbase(session->n_times_c, 256), session->n,
+        session->c, session->t);
+    session_delete(session);
+    if (writer == NULL) {
+        store_close(store);
+        return -1;
+    }
+
+    uint64_t count = 0;
+    uint64_t i;
+    mpz_t w;
+    mpz_init(w);
+    struct store_metadata metadata;
+    int ret;
+    while ((ret = store_next(store, &i, w)) > 0) {
+        store_metadata(store, &metadata);
+        struct bundle_info info = {
+            metadata.host, metadata.kernel, metadata.build,
+            metadata.first_computed, metadata.last_computed,
+        };
+        if (bundle_append(writer, i, w, &info) < 0) {
+            ret = -1;
+            break;
+        }
+        count += 1;
+    }
+    mpz_clear(w);
+    struct bundle_validation validation;
+    while (ret == 0 &&
+           (ret = store_next_validation(store, &validation.from_i,
+                                        &validation.to_i, &validation.result,
+                                        &validation.kernel,
+                                        &validation.validated)) > 0) {
+        ret = bundle_add_validation(writer, &validation);
+    }
+
+    if (bundle_finish(writer) < 0) {
+        ret = -1;
+    }
+    store_close(store);
+    if (ret == 0) {
+        printf("exported %" PRIu64 " checkpoints\n", count);
+    }
+    return ret;
+}
+
+static int check_puzzle(const struct bundle* bundle, struct store* store) {
+    /* Make sure that the database is for the puzzle of the bundle
+     *
+     * A database without checkpoints nor parameters takes those of the
+     * bundle. Version 1 bundles do not tell which puzzle they are for. */
+    struct session* session = session_new();
+    if (session == NULL) {
+        return -1;
+    }
+    mpz_t n, c;
+    mpz_init(n);
+    mpz_init(c);
+    uint64_t t;
+    int ret = 0;
+    int known = session_parameters(session, store);
+    if (known < 0) {
+        ret = -1;
+    } else if (bundle_parameters(bundle, n, c, &t) > 0 &&
+               (mpz_cmp(n, session->n) != 0 || mpz_cmp(c, session->c) != 0 ||
+                t != session->t)) {
+        uint64_t i;
+        if (known > 0 || store_last(store, &i, session->w) != 0 ||
+                store_set_parameters(store, n, c, t) < 0) {
+            ret = -1;
+        }
+    }
+    mpz_clear(c);
+    mpz_clear(n);
+    session_delete(session);
+    return ret;
+}
+
+static int import(const char* bundle_filename, const char* db_filename) {
+    /* Add the checkpoints of a bundle to a database; existing ones are kept */
+    struct bundle* bundle = bundle_open(bundle_filename);
+    if (bundle == NULL) {
+        return -1;
+    }
+    struct store* store = store_open(db_filename, IMPORT_BATCH_SIZE);
+    if (store == NULL) {
+        bundle_close(bundle);
+        return -1;
+    }
+
+    int ret = 0;
+    uint64_t i;
+    mpz_t w;
+    mpz_init(w);
+    if (check_puzzle(bundle, store) < 0) {
+        LOG(WARN, "%s is for another puzzle than %s", bundle_filename,
+            db_filename);
+        ret = -1;
+    }
+    // bundles before version 3 do not record who computed the checkpoints,
+    // nor when
+    struct bundle_info info;
+    for (uint64_t k = 0; ret == 0 && k < bundle->count; k += 1) {
+        if (bundle_get(bundle, k, &i, w) < 0) {
+            ret = -1;
+        } else if (bundle_next_info(bundle, &info) > 0) {
+            struct store_metadata metadata = {
+                info.host, info.kernel, info.build, info.first_computed,
+                info.last_computed,
+            };
+            ret = store_restore(store, i, w, &metadata);
+        } else {
+            ret = store_write(store, STORE_APPEND, i, w, NULL);
+        }
+    }
+    mpz_clear(w);
+    struct bundle_validation validation;
+    while (ret == 0 && bundle_next_validation(bundle, &validation) > 0) {
+        ret = store_restore_validation(store, validation.from_i,
+                                       validation.to_i, validation.kernel,
+                                       validation.result,
+                                       validation.validated);
+    }
+
+    if (store_close(store) < 0) {
+        ret = -1;
+    }
+    if (ret == 0) {
+        printf("imported %" PRIu64 " checkpoints\n", bundle->count);
+    }
+    bundle_close(bundle);
+    return ret;
+}
+
+extern int main(int argc, char** argv) {
+    // parse arguments
+    parse_debug_args(&argc, argv);
+    if (argc != 4) {
+        LOG(FATAL, "usage: %s export savefile.db out.bundle", argv[0]);
+        LOG(FATAL, "usage: %s import in.bundle savefile.db", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int ret;
+    if (strcmp(argv[1], "export") == 0) {
+        ret = export(argv[2], argv[3]);
+    } else if (strcmp(argv[1], "import") == 0) {
+        ret = import(argv[2], argv[3]);
+    } else {
+        LOG(FATAL, "unknown mode %s", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (ret < 0) {
+        LOG(FATAL, "failed to %s checkpoints", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+    return EXIT_SUCCESS;
+}
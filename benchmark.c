@@ -0,0 +1,449 @@
+#define _POSIX_C_SOURCE 200809L
+
+// local includes
+#include "duo.h"
+#include "multi.h"
+#include "session.h"
+#include "store.h"
+#include "time.h"
+#include "util.h"
+
+// POSIX
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// C99
+#include <inttypes.h>
+
+// C90
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// each measurement is repeated until it has run for that long
+#define MIN_SECONDS 0.5
+#define MAX_RESULTS 64
+
+/* Results are all rates (operations per second): higher is better */
+struct result {
+    char name[64];
+    double value;
+};
+
+static struct result results[MAX_RESULTS];
+static size_t n_results;
+
+// argv[0], to find the other tools
+static const char* tool_path;
+
+static void record(const char* name, double value) {
+    if (n_results == MAX_RESULTS) {
+        LOG(FATAL, "too many results");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(results[n_results].name, sizeof(results[n_results].name), "%s",
+             name);
+    results[n_results].value = value;
+    n_results += 1;
+    fprintf(stderr, "%-40s %14.1f /s\n", name, value);
+}
+
+static struct session* session_at(uint64_t i) {
+    /* Session holding a genuine value of w (computed from i = 0) */
+    struct session* session = session_new();
+    if (session == NULL) {
+        LOG(FATAL, "could not allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    session->t = i;
+    while (session_work(session, 1ull<<20)) {
+    }
+    return session;
+}
+
+static void bench_work(void) {
+    /* Squarings per second of session_work() for several block sizes */
+    struct session* session = session_at(1ull << 10);
+    for (unsigned log2 = 10; log2 <= 20; log2 += 5) {
+        uint64_t block = 1ull << log2;
+        uint64_t n = 0;
+        double start = real_clock();
+        double elapsed;
+        do {
+            session->t = session->i + block;
+            session_work(session, block);
+            n += block;
+            elapsed = real_clock() - start;
+        } while (elapsed < MIN_SECONDS);
+        char name[64];
+        snprintf(name, sizeof(name), "work.%s.block_2^%u", SESSION_KERNEL,
+                 log2);
+        record(name, (double) n / elapsed);
+    }
+    session_delete(session);
+}
+
+static void bench_multi(void) {
+    /* Total squarings per second of multi_work() for several lane counts */
+    struct session* session = session_at(1ull << 10);
+    for (size_t n_lanes = 1; n_lanes <= MULTI_MAX_LANES; n_lanes *= 2) {
+        struct multi* multi = multi_new(session->n_times_c, n_lanes);
+        if (multi == NULL) {
+            LOG(FATAL, "could not allocate memory");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t l = 0; l < n_lanes; l += 1) {
+            multi_set(multi, l, session->w);
+        }
+        uint64_t n = 0;
+        double start = real_clock();
+        double elapsed;
+        do {
+            multi_work(multi, 1ull << 10);
+            n += n_lanes << 10;
+            elapsed = real_clock() - start;
+        } while (elapsed < MIN_SECONDS);
+        char name[64];
+        snprintf(name, sizeof(name), "work.%s.lanes_%zu", multi->kernel,
+                 n_lanes);
+        record(name, (double) n / elapsed);
+        multi_delete(multi);
+    }
+    session_delete(session);
+}
+
+static void bench_duo(void) {
+    /* Squarings per second of duo_work(), to compare with work.mpz_powm.* */
+    struct session* session = session_at(1ull << 10);
+    struct duo* duo = duo_new(session->n_times_c);
+    if (duo == NULL) {
+        LOG(FATAL, "could not start duo");
+        exit(EXIT_FAILURE);
+    }
+    duo_set(duo, session->w);
+    uint64_t n = 0;
+    double start = real_clock();
+    double elapsed;
+    do {
+        duo_work(duo, 1ull << 10);
+        n += 1ull << 10;
+        elapsed = real_clock() - start;
+    } while (elapsed < MIN_SECONDS);
+    record("work." DUO_KERNEL ".block_2^10", (double) n / elapsed);
+    duo_delete(duo);
+    session_delete(session);
+}
+
+static void bench_check(void) {
+    /* Calls per second of session_check() */
+    struct session* session = session_at(1ull << 10);
+    uint64_t n = 0;
+    double start = real_clock();
+    double elapsed;
+    do {
+        if (session_check(session) != 0) {
+            LOG(FATAL, "inconsistent session");
+            exit(EXIT_FAILURE);
+        }
+        n += 1;
+        elapsed = real_clock() - start;
+    } while (elapsed < MIN_SECONDS);
+    record("session_check", (double) n / elapsed);
+    session_delete(session);
+}
+
+static void bench_conversions(void) {
+    /* Conversions per second of w, to and from the checkpoint formats */
+    struct session* session = session_at(1ull << 10);
+    mpz_t w;
+    mpz_init(w);
+
+    char* str_w = mpz_get_str(NULL, 10, session->w);
+    uint64_t n = 0;
+    double start = real_clock();
+    double elapsed;
+    do {
+        char* s = mpz_get_str(NULL, 10, session->w);
+        free(s);
+        n += 1;
+        elapsed = real_clock() - start;
+    } while (elapsed < MIN_SECONDS);
+    record("mpz_get_str", (double) n / elapsed);
+
+    n = 0;
+    start = real_clock();
+    do {
+        mpz_set_str(w, str_w, 10);
+        n += 1;
+        elapsed = real_clock() - start;
+    } while (elapsed < MIN_SECONDS);
+    record("mpz_set_str", (double) n / elapsed);
+    free(str_w);
+
+    unsigned char blob[512];
+    size_t size;
+    n = 0;
+    start = real_clock();
+    do {
+        mpz_export(blob, &size, -1, 1, 0, 0, session->w);
+        n += 1;
+        elapsed = real_clock() - start;
+    } while (elapsed < MIN_SECONDS);
+    record("mpz_export", (double) n / elapsed);
+
+    n = 0;
+    start = real_clock();
+    do {
+        mpz_import(w, size, -1, 1, 0, 0, blob);
+        n += 1;
+        elapsed = real_clock() - start;
+    } while (elapsed < MIN_SECONDS);
+    record("mpz_import", (double) n / elapsed);
+
+    mpz_clear(w);
+    session_delete(session);
+}
+
+static void remove_database(const char* filename) {
+    /* Remove a database along with its WAL files */
+    char path[256];
+    remove(filename);
+    snprintf(path, sizeof(path), "%s-wal", filename);
+    remove(path);
+    snprintf(path, sizeof(path), "%s-shm", filename);
+    remove(path);
+}
+
+static void bench_store(void) {
+    /* Checkpoints per second saved with session_checkpoint_append() */
+    struct session* session = session_at(1ull << 10);
+    const char* tmpdir = getenv("TMPDIR");
+    char filename[200];
+    snprintf(filename, sizeof(filename), "%s/lcs35-bench-%ld.db",
+             tmpdir != NULL ? tmpdir : "/tmp", (long) getpid());
+
+    size_t batch_sizes[] = {1, 64};
+    for (size_t k = 0; k < sizeof(batch_sizes) / sizeof(*batch_sizes); k++) {
+        remove_database(filename);
+        struct store* store = store_open(filename, batch_sizes[k]);
+        if (store == NULL) {
+            LOG(FATAL, "failed to open %s", filename);
+            exit(EXIT_FAILURE);
+        }
+        uint64_t n = 0;
+        double start = real_clock();
+        double elapsed;
+        do {
+            session->i += 1;
+            if (session_checkpoint_append(session, store) < 0) {
+                LOG(FATAL, "failed to save checkpoint");
+                exit(EXIT_FAILURE);
+            }
+            n += 1;
+            elapsed = real_clock() - start;
+        } while (elapsed < MIN_SECONDS);
+        // pending writes are part of the cost
+        if (store_close(store) < 0) {
+            LOG(FATAL, "failed to save checkpoints");
+            exit(EXIT_FAILURE);
+        }
+        elapsed = real_clock() - start;
+
+        char name[64];
+        snprintf(name, sizeof(name), "checkpoint_append.batch_%zu",
+                 batch_sizes[k]);
+        record(name, (double) n / elapsed);
+    }
+    remove_database(filename);
+    session_delete(session);
+}
+
+static int run_tool(const char* name, char** args) {
+    /* Run another tool of the project, found next to this one, and wait for
+     * it; its output is discarded */
+    char path[4096];
+    const char* slash = strrchr(tool_path, '/');
+    int length = slash == NULL ? 0 : (int) (slash - tool_path + 1);
+    snprintf(path, sizeof(path), "%.*s%s", length, tool_path, name);
+    args[0] = path;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    } else if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2(null, STDOUT_FILENO);
+        }
+        execv(path, args);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0) {
+        LOG(WARN, "%s failed", path);
+        return -1;
+    }
+    return 0;
+}
+
+static void bench_validate(void) {
+    /* Total squarings per second of validate itself, on a test puzzle of the
+     * size of LCS35 with enough intervals to keep all threads and lanes busy
+     *
+     * This goes through the deques, the store and the kernel selection of
+     * validate, along with loading the checkpoints and saving the results. */
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cpus < 1) {
+        n_cpus = 1;
+    }
+    const char* tmpdir = getenv("TMPDIR");
+    char filename[200];
+    snprintf(filename, sizeof(filename), "%s/lcs35-bench-validate-%ld.db",
+             tmpdir != NULL ? tmpdir : "/tmp", (long) getpid());
+
+    // intervals of about MIN_SECONDS / 4 of session_work() each
+    double start = real_clock();
+    struct session* session = session_at(1ull << 16);
+    session_delete(session);
+    double rate = (double) (1ull << 16) / (real_clock() - start);
+    unsigned spacing = 10;
+    while ((double) (1ull << (spacing + 1)) < rate * MIN_SECONDS / 4) {
+        spacing += 1;
+    }
+
+    for (size_t n_threads = 1; n_threads <= (size_t) n_cpus; n_threads *= 2) {
+        uint64_t n_intervals = 4 * MULTI_MAX_LANES * n_threads;
+        char str_t[32], str_spacing[32], str_threads[32];
+        snprintf(str_t, sizeof(str_t), "%" PRIu64, n_intervals << spacing);
+        snprintf(str_spacing, sizeof(str_spacing), "%u", spacing);
+        snprintf(str_threads, sizeof(str_threads), "%zu", n_threads);
+        char* create_args[] = {NULL, "create", "--bits", "1024", "-t", str_t,
+                               "--spacing", str_spacing, filename, NULL};
+        char* validate_args[] = {NULL, "-j", str_threads, filename, NULL};
+
+        remove_database(filename);
+        if (run_tool("puzzle", create_args) < 0) {
+            LOG(FATAL, "failed to create %s", filename);
+            exit(EXIT_FAILURE);
+        }
+        start = real_clock();
+        if (run_tool("validate", validate_args) < 0) {
+            LOG(FATAL, "failed to validate %s", filename);
+            exit(EXIT_FAILURE);
+        }
+        double elapsed = real_clock() - start;
+
+        char name[64];
+        snprintf(name, sizeof(name), "validate.threads_%zu", n_threads);
+        record(name, (double) (n_intervals << spacing) / elapsed);
+    }
+    remove_database(filename);
+}
+
+static int write_results(FILE* f) {
+    /* One result per line, so that read_baseline() stays simple */
+    char brand_string[49];
+    get_brand_string(brand_string);
+    fprintf(f, "{\n");
+    fprintf(f, "  \"cpu\": \"%s\",\n", brand_string);
+    fprintf(f, "  \"results\": {\n");
+    for (size_t k = 0; k < n_results; k += 1) {
+        fprintf(f, "    \"%s\": %.1f%s\n", results[k].name, results[k].value,
+                k + 1 < n_results ? "," : "");
+    }
+    fprintf(f, "  }\n");
+    fprintf(f, "}\n");
+    return ferror(f) ? -1 : 0;
+}
+
+static int compare_baseline(const char* filename, double threshold) {
+    /* Check results against a file written by write_results()
+     *
+     * returns the number of regressions, or -1 on error */
+    FILE* f = fopen(filename, "r");
+    if (f == NULL) {
+        LOG(WARN, "failed to open %s", filename);
+        return -1;
+    }
+
+    int n_regressions = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char name[64];
+        double baseline;
+        if (sscanf(line, " \"%63[^\"]\": %lf", name, &baseline) != 2) {
+            continue;
+        }
+        for (size_t k = 0; k < n_results; k += 1) {
+            if (strcmp(results[k].name, name) != 0) {
+                continue;
+            }
+            double ratio = results[k].value / baseline;
+            int regression = ratio < 1 - threshold;
+            fprintf(stderr, "%-40s %+6.1f%%%s\n", name, 100 * (ratio - 1),
+                    regression ? "  REGRESSION" : "");
+            n_regressions += regression;
+        }
+    }
+    fclose(f);
+    return n_regressions;
+}
+
+extern int main(int argc, char** argv) {
+    // parse arguments
+    parse_debug_args(&argc, argv);
+    const char* output = NULL;
+    const char* baseline = NULL;
+    double threshold = 0.1;
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "--output") == 0 ||
+                strcmp(argv[arg], "-o") == 0) {
+            output = argv[arg+1];
+        } else if (strcmp(argv[arg], "--baseline") == 0) {
+            baseline = argv[arg+1];
+        } else if (strcmp(argv[arg], "--threshold") == 0) {
+            threshold = strtod(argv[arg+1], NULL);
+        } else {
+            break;
+        }
+        arg += 2;
+    }
+    if (argc != arg) {
+        LOG(FATAL, "usage: %s [--output results.json] "
+            "[--baseline baseline.json [--threshold fraction]]", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    tool_path = argv[0];
+    bench_work();
+    bench_multi();
+    bench_duo();
+    bench_check();
+    bench_conversions();
+    bench_store();
+    bench_validate();
+
+    FILE* f = output == NULL ? stdout : fopen(output, "w");
+    if (f == NULL || write_results(f) < 0) {
+        LOG(FATAL, "failed to write results");
+        exit(EXIT_FAILURE);
+    }
+    if (f != stdout) {
+        fclose(f);
+    }
+
+    if (baseline != NULL) {
+        int n_regressions = compare_baseline(baseline, threshold);
+        if (n_regressions < 0) {
+            LOG(FATAL, "failed to read %s", baseline);
+            exit(EXIT_FAILURE);
+        } else if (n_regressions > 0) {
+            LOG(FATAL, "%i regressions against %s", n_regressions, baseline);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,11 @@
+#ifndef BUILD_H
+#define BUILD_H
+
+/* Revision of the code (git describe), recorded with each checkpoint to trace
+ * results back to the code
+ *
+ * Defined in build.c, which the Makefile rewrites whenever the revision
+ * changes, so that it never names an older build. */
+extern const char build_revision[];
+
+#endif
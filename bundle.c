@@ -0,0 +1,658 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "bundle.h" // source header
+
+// local includes
+#include "util.h"
+
+// POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// C99
+#include <inttypes.h>
+
+// C90
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// reflected polynomial 0xedb88320 (same as zlib); constant, so that the
+// stream writer thread and the main thread can both use it
+static const uint32_t crc32_table[256] = {
+    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
+    0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
+    0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
+    0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
+    0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
+    0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
+    0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
+    0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
+    0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
+    0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
+    0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
+    0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
+    0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
+    0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
+    0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
+    0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
+    0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
+    0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
+    0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
+    0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
+    0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
+    0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
+    0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
+    0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
+    0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
+    0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
+    0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
+    0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
+    0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
+    0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
+    0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
+    0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
+    0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
+};
+
+extern uint32_t crc32(uint32_t crc, const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    crc = ~crc;
+    for (size_t k = 0; k < size; k += 1) {
+        crc = crc32_table[(crc ^ bytes[k]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void put_u32(unsigned char* p, uint32_t v) {
+    for (int k = 0; k < 4; k += 1) {
+        p[k] = (unsigned char) (v >> (8 * k));
+    }
+}
+
+static void put_u64(unsigned char* p, uint64_t v) {
+    for (int k = 0; k < 8; k += 1) {
+        p[k] = (unsigned char) (v >> (8 * k));
+    }
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    uint32_t v = 0;
+    for (int k = 3; k >= 0; k -= 1) {
+        v = (v << 8) | p[k];
+    }
+    return v;
+}
+
+static uint64_t get_u64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int k = 7; k >= 0; k -= 1) {
+        v = (v << 8) | p[k];
+    }
+    return v;
+}
+
+extern size_t bundle_record_size(size_t w_size) {
+    return (8 + w_size + 4 + 7) / 8 * 8;
+}
+
+extern size_t bundle_puzzle_size(size_t n_size, size_t c_size) {
+    return (n_size + c_size + 7) / 8 * 8;
+}
+
+extern unsigned char* bundle_encode_puzzle(const mpz_t n, const mpz_t c,
+                                           size_t* n_size, size_t* c_size) {
+    /* Allocate the puzzle of a bundle or stream: n and c, padded */
+    *n_size = mpz_sizeinbase(n, 256);
+    *c_size = mpz_sizeinbase(c, 256);
+    unsigned char* puzzle = calloc(1, bundle_puzzle_size(*n_size, *c_size));
+    if (puzzle == NULL) {
+        return NULL;
+    }
+    mpz_export(puzzle, NULL, -1, 1, 0, 0, n);
+    mpz_export(puzzle + *n_size, NULL, -1, 1, 0, 0, c);
+    return puzzle;
+}
+
+extern int bundle_encode(unsigned char* record, size_t w_size, uint64_t i,
+                         const mpz_t w) {
+    /* Fill a record of bundle_record_size(w_size) bytes */
+    if (mpz_sgn(w) < 0 || mpz_sizeinbase(w, 256) > w_size) {
+        LOG(WARN, "w does not fit in %zu bytes", w_size);
+        return -1;
+    }
+    memset(record, 0, bundle_record_size(w_size));
+    put_u64(record, i);
+    mpz_export(record + 8, NULL, -1, 1, 0, 0, w);
+    put_u32(record + 8 + w_size, crc32(0, record, 8 + w_size));
+    return 0;
+}
+
+extern int bundle_decode(const unsigned char* record, size_t w_size,
+                         uint64_t* i, mpz_t w) {
+    /* Read a record; returns -1 if it is corrupted */
+    if (get_u32(record + 8 + w_size) != crc32(0, record, 8 + w_size)) {
+        return -1;
+    }
+    *i = get_u64(record);
+    mpz_import(w, w_size, -1, 1, 0, 0, record + 8);
+    return 0;
+}
+
+extern int bundle_probe(const char* filename) {
+    /* Return 1 if the file looks like a bundle */
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) {
+        return 0;
+    }
+    char magic[8];
+    size_t n = fread(magic, 1, sizeof(magic), f);
+    fclose(f);
+    return n == sizeof(magic) && memcmp(magic, BUNDLE_MAGIC, 8) == 0;
+}
+
+static int read_column(const unsigned char** p, const unsigned char* end,
+                       const char** value) {
+    /* Read a column of the metadata and move past it
+     *
+     * returns -1 if it does not fit before end or is malformed */
+    if (*p >= end || **p > 1) {
+        return -1;
+    }
+    *p += 1;
+    if ((*p)[-1] == 0) {
+        *value = NULL;
+        return 0;
+    }
+    const unsigned char* nul = memchr(*p, 0, (size_t) (end - *p));
+    if (nul == NULL) {
+        return -1;
+    }
+    *value = (const char*) *p;
+    *p = nul + 1;
+    return 0;
+}
+
+static int read_info(const unsigned char** p, const unsigned char* end,
+                     struct bundle_info* info) {
+    if (read_column(p, end, &info->host) < 0 ||
+            read_column(p, end, &info->kernel) < 0 ||
+            read_column(p, end, &info->build) < 0 ||
+            read_column(p, end, &info->first_computed) < 0 ||
+            read_column(p, end, &info->last_computed) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int read_validation(const unsigned char** p, const unsigned char* end,
+                           struct bundle_validation* validation) {
+    if (end - *p < 20) {
+        return -1;
+    }
+    validation->from_i = get_u64(*p);
+    validation->to_i = get_u64(*p + 8);
+    uint32_t result = get_u32(*p + 16);
+    if (result > 1 && result != 0xffffffff) {
+        return -1;
+    }
+    validation->result = result == 0xffffffff ? -1 : (int) result;
+    *p += 20;
+    if (read_column(p, end, &validation->kernel) < 0 ||
+            read_column(p, end, &validation->validated) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int check_metadata(struct bundle* bundle, size_t offset,
+                          const char* filename) {
+    /* Check the metadata section that starts at offset, so that it can then
+     * be read without bounds checks */
+    const unsigned char* metadata = bundle->data + offset;
+    const unsigned char* end = bundle->data + bundle->size - 12;
+    size_t size = (size_t) (end + 8 - metadata);
+    if (get_u32(end + 8) != crc32(0, metadata, size)) {
+        LOG(WARN, "corrupted bundle metadata in %s", filename);
+        return -1;
+    }
+    bundle->n_validations = get_u64(end);
+    const unsigned char* p = metadata;
+    struct bundle_info info;
+    for (uint64_t k = 0; k < bundle->count; k += 1) {
+        if (read_info(&p, end, &info) < 0) {
+            LOG(WARN, "malformed bundle metadata in %s", filename);
+            return -1;
+        }
+    }
+    bundle->validations = p;
+    struct bundle_validation validation;
+    for (uint64_t k = 0; k < bundle->n_validations; k += 1) {
+        if (read_validation(&p, end, &validation) < 0) {
+            LOG(WARN, "malformed bundle metadata in %s", filename);
+            return -1;
+        }
+    }
+    if (p != end) {
+        LOG(WARN, "malformed bundle metadata in %s", filename);
+        return -1;
+    }
+    bundle->next_info = metadata;
+    bundle->next_validation = bundle->validations;
+    bundle->validations_read = 0;
+    return 0;
+}
+
+extern struct bundle* bundle_open(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        LOG(WARN, "failed to open %s (%s)", filename, strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        LOG(WARN, "failed to stat %s (%s)", filename, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t) st.st_size;
+    if (size < BUNDLE_V1_HEADER_SIZE) {
+        LOG(WARN, "%s is too short to be a bundle", filename);
+        close(fd);
+        return NULL;
+    }
+    void* data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);  // the mapping keeps the file open
+    if (data == MAP_FAILED) {
+        LOG(WARN, "failed to map %s (%s)", filename, strerror(errno));
+        return NULL;
+    }
+
+    struct bundle* bundle = malloc(sizeof(*bundle));
+    if (bundle == NULL) {
+        munmap(data, size);
+        return NULL;
+    }
+    bundle->data = data;
+    bundle->size = size;
+
+    // check header; its layout depends on the version
+    const unsigned char* header = bundle->data;
+    if (memcmp(header, BUNDLE_MAGIC, 8) != 0) {
+        LOG(WARN, "%s is not a bundle", filename);
+        goto fail;
+    }
+    uint32_t version = get_u32(header + 8);
+    size_t header_size = BUNDLE_V1_HEADER_SIZE;
+    size_t puzzle_size = 0;
+    uint32_t index_crc;
+    if (version == 1) {
+        index_crc = get_u32(header + 24);
+        if (get_u32(header + 28) != crc32(0, header, 28)) {
+            LOG(WARN, "corrupted bundle header in %s", filename);
+            goto fail;
+        }
+        bundle->n = NULL;
+        bundle->c = NULL;
+    } else if (version == 2 || version == BUNDLE_VERSION) {
+        header_size = BUNDLE_HEADER_SIZE;
+        if (size < header_size) {
+            LOG(WARN, "%s is too short to be a bundle", filename);
+            goto fail;
+        }
+        bundle->t = get_u64(header + 24);
+        bundle->n_size = get_u32(header + 32);
+        bundle->c_size = get_u32(header + 36);
+        puzzle_size = bundle_puzzle_size(bundle->n_size, bundle->c_size);
+        if (size < header_size + puzzle_size) {
+            LOG(WARN, "bundle %s is truncated", filename);
+            goto fail;
+        }
+        bundle->n = header + header_size;
+        bundle->c = bundle->n + bundle->n_size;
+        index_crc = get_u32(header + 40);
+        if (get_u32(header + 44) !=
+                crc32(crc32(0, header, 44), bundle->n, puzzle_size)) {
+            LOG(WARN, "corrupted bundle header in %s", filename);
+            goto fail;
+        }
+    } else {
+        LOG(WARN, "unsupported bundle version %" PRIu32, version);
+        goto fail;
+    }
+    bundle->w_size = get_u32(header + 12);
+    bundle->count = get_u64(header + 16);
+    bundle->record_size = bundle_record_size(bundle->w_size);
+    if (bundle->count > size / (bundle->record_size + 8)) {
+        LOG(WARN, "bundle %s is truncated", filename);
+        goto fail;
+    }
+    uint64_t records_size = bundle->count * bundle->record_size;
+    size_t records_offset = header_size + puzzle_size;
+    size_t index_end = records_offset + records_size + 8 * bundle->count;
+    size_t metadata_size = version < 3 ? 0 : 12;
+    if (size < index_end + metadata_size ||
+            (version < 3 && size != index_end)) {
+        LOG(WARN, "bundle %s is truncated", filename);
+        goto fail;
+    }
+    bundle->records = bundle->data + records_offset;
+    bundle->index = bundle->records + records_size;
+    if (index_crc != crc32(0, bundle->index, 8 * bundle->count)) {
+        LOG(WARN, "corrupted bundle index in %s", filename);
+        goto fail;
+    }
+    bundle->validations = NULL;
+    if (version >= 3 && check_metadata(bundle, index_end, filename) < 0) {
+        goto fail;
+    }
+
+    return bundle;
+
+fail:
+    bundle_close(bundle);
+    return NULL;
+}
+
+extern void bundle_close(struct bundle* bundle) {
+    munmap((void*) bundle->data, bundle->size);
+    free(bundle);
+}
+
+extern int bundle_get(const struct bundle* bundle, uint64_t k, uint64_t* i,
+                      mpz_t w) {
+    /* Read the k-th record; returns -1 if it is corrupted */
+    const unsigned char* record = bundle->records + k * bundle->record_size;
+    if (bundle_decode(record, bundle->w_size, i, w) < 0) {
+        LOG(WARN, "corrupted record %" PRIu64 " in bundle", k);
+        return -1;
+    }
+    if (*i != get_u64(bundle->index + 8 * k)) {
+        LOG(WARN, "record %" PRIu64 " does not match the index", k);
+        return -1;
+    }
+    return 0;
+}
+
+extern uint64_t bundle_find(const struct bundle* bundle, uint64_t i) {
+    /* Position of the first record whose i is not less than the given one */
+    uint64_t low = 0;
+    uint64_t high = bundle->count;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (get_u64(bundle->index + 8 * mid) < i) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+extern int bundle_parameters(const struct bundle* bundle, mpz_t n, mpz_t c,
+                             uint64_t* t) {
+    /* Read the modulus, control prime and target of the puzzle
+     *
+     * returns 1 if the bundle records them
+     * returns 0 for a version 1 bundle, which is for LCS35 itself */
+    if (bundle->n == NULL) {
+        return 0;
+    }
+    mpz_import(n, bundle->n_size, -1, 1, 0, 0, bundle->n);
+    mpz_import(c, bundle->c_size, -1, 1, 0, 0, bundle->c);
+    *t = bundle->t;
+    return 1;
+}
+
+extern int bundle_next_info(struct bundle* bundle, struct bundle_info* info) {
+    /* Read the metadata of the next record, in the order of the records
+     *
+     * the strings point into the bundle; they are NULL when unknown
+     *
+     * returns 1 if the metadata was read
+     * returns 0 after the last record, or if the bundle has no metadata */
+    if (bundle->validations == NULL ||
+            bundle->next_info == bundle->validations) {
+        return 0;
+    }
+    read_info(&bundle->next_info, bundle->validations, info);
+    return 1;
+}
+
+extern int bundle_next_validation(struct bundle* bundle,
+                                  struct bundle_validation* validation) {
+    /* Read the next row of the validation table
+     *
+     * returns 1 if a row was read
+     * returns 0 after the last row, or if the bundle has no metadata */
+    if (bundle->validations == NULL ||
+            bundle->validations_read == bundle->n_validations) {
+        return 0;
+    }
+    read_validation(&bundle->next_validation,
+                    bundle->data + bundle->size - 12, validation);
+    bundle->validations_read += 1;
+    return 1;
+}
+
+static void free_writer(struct bundle_writer* writer) {
+    if (writer->file != NULL) {
+        fclose(writer->file);
+    }
+    if (writer->metadata != NULL) {
+        fclose(writer->metadata);
+    }
+    free(writer->index);
+    free(writer->puzzle);
+    free(writer->record);
+    free(writer);
+}
+
+static int write_column(FILE* f, const char* value) {
+    /* Write a column of the metadata; see read_column() */
+    if (value == NULL) {
+        return fputc(0, f) == EOF ? -1 : 0;
+    }
+    if (fputc(1, f) == EOF || fputs(value, f) == EOF || fputc(0, f) == EOF) {
+        return -1;
+    }
+    return 0;
+}
+
+extern struct bundle_writer* bundle_create(const char* filename,
+                                           size_t w_size, const mpz_t n,
+                                           const mpz_t c, uint64_t t) {
+    /* Start a bundle of checkpoints of the puzzle with modulus n, control
+     * prime c and target t */
+    struct bundle_writer* writer = calloc(1, sizeof(*writer));
+    if (writer == NULL) {
+        return NULL;
+    }
+    writer->w_size = w_size;
+    writer->record_size = bundle_record_size(w_size);
+    writer->record = calloc(1, writer->record_size);
+    writer->puzzle = bundle_encode_puzzle(n, c, &writer->n_size,
+                                          &writer->c_size);
+    writer->t = t;
+    if (writer->record == NULL || writer->puzzle == NULL) {
+        free_writer(writer);
+        return NULL;
+    }
+
+    // the metadata goes after the index, whose size is only known at the end
+    writer->metadata = tmpfile();
+    if (writer->metadata == NULL) {
+        LOG(WARN, "failed to create temporary file (%s)", strerror(errno));
+        free_writer(writer);
+        return NULL;
+    }
+    writer->file = fopen(filename, "wb");
+    if (writer->file == NULL) {
+        LOG(WARN, "failed to create %s (%s)", filename, strerror(errno));
+        free_writer(writer);
+        return NULL;
+    }
+
+    // the header is written last, once count is known
+    unsigned char header[BUNDLE_HEADER_SIZE] = {0};
+    if (fwrite(header, sizeof(header), 1, writer->file) != 1 ||
+            fwrite(writer->puzzle, bundle_puzzle_size(writer->n_size,
+                                                      writer->c_size),
+                   1, writer->file) != 1) {
+        LOG(WARN, "failed to write bundle (%s)", strerror(errno));
+        free_writer(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+extern int bundle_append(struct bundle_writer* writer, uint64_t i,
+                         const mpz_t w, const struct bundle_info* info) {
+    /* Add a record, with its metadata if info is not NULL; values of i must
+     * be increasing, and records come before validation rows */
+    if (writer->count > 0 && i <= writer->index[writer->count - 1]) {
+        LOG(WARN, "records must be appended in increasing order of i");
+        return -1;
+    }
+    if (writer->n_validations > 0) {
+        LOG(WARN, "records must be appended before validation rows");
+        return -1;
+    }
+    // grow index
+    if (writer->count == writer->capacity) {
+        uint64_t capacity = writer->capacity == 0 ? 1024 : 2 * writer->capacity;
+        uint64_t* index = realloc(writer->index, capacity * sizeof(*index));
+        if (index == NULL) {
+            LOG(WARN, "could not allocate memory (%s)", strerror(errno));
+            return -1;
+        }
+        writer->index = index;
+        writer->capacity = capacity;
+    }
+
+    if (bundle_encode(writer->record, writer->w_size, i, w) < 0) {
+        return -1;
+    }
+    if (fwrite(writer->record, writer->record_size, 1, writer->file) != 1) {
+        LOG(WARN, "failed to write bundle (%s)", strerror(errno));
+        return -1;
+    }
+    struct bundle_info unknown = {NULL, NULL, NULL, NULL, NULL};
+    if (info == NULL) {
+        info = &unknown;
+    }
+    if (write_column(writer->metadata, info->host) < 0 ||
+            write_column(writer->metadata, info->kernel) < 0 ||
+            write_column(writer->metadata, info->build) < 0 ||
+            write_column(writer->metadata, info->first_computed) < 0 ||
+            write_column(writer->metadata, info->last_computed) < 0) {
+        LOG(WARN, "failed to write bundle metadata (%s)", strerror(errno));
+        return -1;
+    }
+
+    writer->index[writer->count] = i;
+    writer->count += 1;
+    return 0;
+}
+
+extern int bundle_add_validation(struct bundle_writer* writer,
+                                 const struct bundle_validation* validation) {
+    /* Add a row of the validation table, after all records */
+    unsigned char fields[20];
+    put_u64(fields, validation->from_i);
+    put_u64(fields + 8, validation->to_i);
+    put_u32(fields + 16, validation->result < 0 ? 0xffffffff :
+                         (uint32_t) validation->result);
+    if (fwrite(fields, sizeof(fields), 1, writer->metadata) != 1 ||
+            write_column(writer->metadata, validation->kernel) < 0 ||
+            write_column(writer->metadata, validation->validated) < 0) {
+        LOG(WARN, "failed to write bundle metadata (%s)", strerror(errno));
+        return -1;
+    }
+    writer->n_validations += 1;
+    return 0;
+}
+
+static int write_metadata(struct bundle_writer* writer) {
+    /* Copy the metadata after the index, followed by the number of
+     * validation rows and the CRC */
+    if (fflush(writer->metadata) != 0 ||
+            fseek(writer->metadata, 0, SEEK_SET) != 0) {
+        return -1;
+    }
+    uint32_t crc = 0;
+    unsigned char buffer[1 << 16];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), writer->metadata)) > 0) {
+        crc = crc32(crc, buffer, size);
+        if (fwrite(buffer, 1, size, writer->file) != size) {
+            return -1;
+        }
+    }
+    if (ferror(writer->metadata)) {
+        return -1;
+    }
+    unsigned char trailer[12];
+    put_u64(trailer, writer->n_validations);
+    put_u32(trailer + 8, crc32(crc, trailer, 8));
+    return fwrite(trailer, sizeof(trailer), 1, writer->file) == 1 ? 0 : -1;
+}
+
+extern int bundle_finish(struct bundle_writer* writer) {
+    /* Write index, metadata and header, and release the writer */
+    int ret = 0;
+
+    uint32_t index_crc = 0;
+    unsigned char entry[8];
+    for (uint64_t k = 0; k < writer->count; k += 1) {
+        put_u64(entry, writer->index[k]);
+        index_crc = crc32(index_crc, entry, sizeof(entry));
+        if (fwrite(entry, sizeof(entry), 1, writer->file) != 1) {
+            LOG(WARN, "failed to write bundle (%s)", strerror(errno));
+            ret = -1;
+            break;
+        }
+    }
+    if (ret == 0 && write_metadata(writer) < 0) {
+        LOG(WARN, "failed to write bundle metadata (%s)", strerror(errno));
+        ret = -1;
+    }
+
+    unsigned char header[BUNDLE_HEADER_SIZE];
+    memcpy(header, BUNDLE_MAGIC, 8);
+    put_u32(header + 8, BUNDLE_VERSION);
+    put_u32(header + 12, (uint32_t) writer->w_size);
+    put_u64(header + 16, writer->count);
+    put_u64(header + 24, writer->t);
+    put_u32(header + 32, (uint32_t) writer->n_size);
+    put_u32(header + 36, (uint32_t) writer->c_size);
+    put_u32(header + 40, index_crc);
+    put_u32(header + 44, crc32(crc32(0, header, 44), writer->puzzle,
+                               bundle_puzzle_size(writer->n_size,
+                                                  writer->c_size)));
+    if (ret == 0 && (fseek(writer->file, 0, SEEK_SET) != 0 ||
+                     fwrite(header, sizeof(header), 1, writer->file) != 1)) {
+        LOG(WARN, "failed to write bundle header (%s)", strerror(errno));
+        ret = -1;
+    }
+
+    if (fclose(writer->file) != 0) {
+        LOG(WARN, "failed to close bundle (%s)", strerror(errno));
+        ret = -1;
+    }
+    writer->file = NULL;
+    free_writer(writer);
+    return ret;
+}
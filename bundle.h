@@ -0,0 +1,131 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+// external libraries
+#include <gmp.h>
+
+// C99
+#include <stdint.h>
+
+// C90
+#include <stdio.h>
+
+/* Checkpoint bundle
+ *
+ * A bundle is a read-only file holding checkpoints in increasing order of i,
+ * meant to be memory-mapped. All integers are little-endian.
+ *
+ *   header    magic "LCS35BDL", version (u32), w_size (u32), count (u64),
+ *             t (u64), n_size (u32), c_size (u32), CRC-32 of the index (u32),
+ *             CRC-32 of the previous fields followed by the puzzle (u32)
+ *   puzzle    n (n_size bytes) and c (c_size bytes), padded to a multiple of
+ *             8 bytes; with t, the parameters of the puzzle the checkpoints
+ *             belong to, as in the parameter table of a database
+ *   records   count fixed-size records: i (u64), w (w_size bytes), CRC-32 of
+ *             i and w (u32), padding to a multiple of 8 bytes
+ *   index     count values of i (u64), for binary search without touching
+ *             the records
+ *   metadata  for each record, the host, kernel, build, first_computed and
+ *             last_computed columns of its row; then the rows of the
+ *             validation table: from_i (u64), to_i (u64), result (u32,
+ *             0xffffffff while pending), kernel and validated; then the
+ *             number of these rows (u64) and the CRC-32 of the section (u32)
+ *
+ * Each column of the metadata is a byte 0 for NULL, or a byte 1 followed by
+ * the text and a NUL byte. Version 2 bundles have no metadata; version 1
+ * bundles have a 32-byte header without t, n_size and c_size, and no
+ * puzzle: they only hold checkpoints of LCS35 itself. */
+#define BUNDLE_MAGIC "LCS35BDL"
+#define BUNDLE_VERSION 3
+#define BUNDLE_HEADER_SIZE 48
+#define BUNDLE_V1_HEADER_SIZE 32
+
+// columns of a checkpoint row besides i and w; NULL when unknown
+struct bundle_info {
+    const char* host;
+    const char* kernel;
+    const char* build;
+    const char* first_computed;
+    const char* last_computed;
+};
+
+// row of the validation table
+struct bundle_validation {
+    uint64_t from_i;
+    uint64_t to_i;
+    int result;  // -1 while pending
+    const char* kernel;
+    const char* validated;
+};
+
+struct bundle {
+    const unsigned char* data;  // whole mapped file
+    size_t size;
+    uint64_t count;
+    size_t w_size;
+    size_t record_size;
+    const unsigned char* n;  // NULL for a version 1 bundle
+    size_t n_size;
+    const unsigned char* c;
+    size_t c_size;
+    uint64_t t;
+    const unsigned char* records;
+    const unsigned char* index;
+    // validation rows of the metadata, NULL before version 3; metadata is
+    // read in order by bundle_next_info() and bundle_next_validation()
+    const unsigned char* validations;
+    const unsigned char* next_info;
+    const unsigned char* next_validation;
+    uint64_t n_validations;
+    uint64_t validations_read;
+};
+
+struct bundle_writer {
+    FILE* file;
+    size_t w_size;
+    size_t record_size;
+    unsigned char* puzzle;  // n and c, as written after the header
+    size_t n_size;
+    size_t c_size;
+    uint64_t t;
+    unsigned char* record;  // buffer for one record
+    uint64_t* index;
+    uint64_t count;
+    uint64_t capacity;
+    FILE* metadata;  // temporary file, copied after the index
+    uint64_t n_validations;
+};
+
+extern uint32_t crc32(uint32_t crc, const void* data, size_t size);
+
+extern size_t bundle_record_size(size_t w_size);
+extern size_t bundle_puzzle_size(size_t n_size, size_t c_size);
+extern unsigned char* bundle_encode_puzzle(const mpz_t n, const mpz_t c,
+                                           size_t* n_size, size_t* c_size);
+extern int bundle_encode(unsigned char* record, size_t w_size, uint64_t i,
+                         const mpz_t w);
+extern int bundle_decode(const unsigned char* record, size_t w_size,
+                         uint64_t* i, mpz_t w);
+
+extern int bundle_probe(const char* filename);
+extern struct bundle* bundle_open(const char* filename);
+extern void bundle_close(struct bundle* bundle);
+extern int bundle_get(const struct bundle* bundle, uint64_t k, uint64_t* i,
+                      mpz_t w);
+extern uint64_t bundle_find(const struct bundle* bundle, uint64_t i);
+extern int bundle_parameters(const struct bundle* bundle, mpz_t n, mpz_t c,
+                             uint64_t* t);
+extern int bundle_next_info(struct bundle* bundle, struct bundle_info* info);
+extern int bundle_next_validation(struct bundle* bundle,
+                                  struct bundle_validation* validation);
+
+extern struct bundle_writer* bundle_create(const char* filename,
+                                           size_t w_size, const mpz_t n,
+                                           const mpz_t c, uint64_t t);
+extern int bundle_append(struct bundle_writer* writer, uint64_t i,
+                         const mpz_t w, const struct bundle_info* info);
+extern int bundle_add_validation(struct bundle_writer* writer,
+                                 const struct bundle_validation* validation);
+extern int bundle_finish(struct bundle_writer* writer);
+
+#endif
@@ -0,0 +1,400 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "checkpoints.h" // source header
+
+// local includes
+#include "bundle.h"
+#include "session.h"
+#include "store.h"
+#include "stream.h"
+#include "util.h"
+
+// C99
+#include <inttypes.h>
+
+// C90
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern int checkpoints_push(struct checkpoints* checkpoints, uint64_t i,
+                            const mpz_t w) {
+    /* Add a checkpoint after all others */
+    if (checkpoints->count == checkpoints->capacity) {
+        size_t capacity = checkpoints->capacity == 0 ? 1024 :
+                          2 * checkpoints->capacity;
+        struct checkpoint* items =
+            realloc(checkpoints->items, capacity * sizeof(*items));
+        if (items == NULL) {
+            LOG(WARN, "could not allocate memory (%s)", strerror(errno));
+            return -1;
+        }
+        checkpoints->items = items;
+        checkpoints->capacity = capacity;
+    }
+
+    struct checkpoint* checkpoint = &checkpoints->items[checkpoints->count];
+    checkpoint->i = i;
+    mpz_init_set(checkpoint->w, w);
+    checkpoint->host = -1;
+    checkpoint->kernel = -1;
+    checkpoints->count += 1;
+    return 0;
+}
+
+static int intern(char*** names, size_t* n_names, const char* name) {
+    /* Index of name in *names, adding it if needed */
+    if (name == NULL) {
+        return -1;
+    }
+    // there are only a handful of workers and kernels
+    for (size_t k = 0; k < *n_names; k += 1) {
+        if (strcmp((*names)[k], name) == 0) {
+            return (int) k;
+        }
+    }
+    char** new_names = realloc(*names, (*n_names + 1) * sizeof(*new_names));
+    if (new_names == NULL) {
+        return -1;
+    }
+    *names = new_names;
+    size_t size = strlen(name) + 1;
+    new_names[*n_names] = malloc(size);
+    if (new_names[*n_names] == NULL) {
+        return -1;
+    }
+    memcpy(new_names[*n_names], name, size);
+    *n_names += 1;
+    return (int) *n_names - 1;
+}
+
+static int load_bundle(struct checkpoints* checkpoints, const char* filename) {
+    struct bundle* bundle = bundle_open(filename);
+    if (bundle == NULL) {
+        return -1;
+    }
+    bundle_parameters(bundle, checkpoints->n, checkpoints->c, &checkpoints->t);
+
+    int ret = 0;
+    uint64_t i;
+    mpz_t w;
+    mpz_init(w);
+    struct bundle_info info;
+    for (uint64_t k = 0; k < bundle->count; k += 1) {
+        if (bundle_get(bundle, k, &i, w) < 0 ||
+                checkpoints_push(checkpoints, i, w) < 0) {
+            ret = -1;
+            break;
+        }
+        if (bundle_next_info(bundle, &info) > 0) {
+            struct checkpoint* checkpoint =
+                &checkpoints->items[checkpoints->count - 1];
+            checkpoint->host = intern(&checkpoints->hosts,
+                                      &checkpoints->n_hosts, info.host);
+            checkpoint->kernel = intern(&checkpoints->kernels,
+                                        &checkpoints->n_kernels, info.kernel);
+        }
+    }
+    mpz_clear(w);
+
+    bundle_close(bundle);
+    return ret;
+}
+
+static int push_interval(struct interval** items, size_t* count,
+                         size_t* capacity, struct interval interval) {
+    /* Add an interval after all others */
+    if (*count == *capacity) {
+        size_t new_capacity = *capacity == 0 ? 1024 : 2 * *capacity;
+        struct interval* new_items =
+            realloc(*items, new_capacity * sizeof(*new_items));
+        if (new_items == NULL) {
+            LOG(WARN, "could not allocate memory (%s)", strerror(errno));
+            return -1;
+        }
+        *items = new_items;
+        *capacity = new_capacity;
+    }
+    (*items)[*count] = interval;
+    *count += 1;
+    return 0;
+}
+
+static int load_database(struct checkpoints* checkpoints,
+                         const char* filename) {
+    struct store* store = store_open_existing(filename, 1);
+    if (store == NULL) {
+        return -1;
+    }
+    if (store_parameters(store, checkpoints->n, checkpoints->c,
+                         &checkpoints->t) < 0) {
+        store_close(store);
+        return -1;
+    }
+
+    int ret;
+    uint64_t i;
+    mpz_t w;
+    mpz_init(w);
+    while ((ret = store_next(store, &i, w)) > 0) {
+        if (checkpoints_push(checkpoints, i, w) < 0) {
+            ret = -1;
+            break;
+        }
+        struct checkpoint* checkpoint =
+            &checkpoints->items[checkpoints->count - 1];
+        checkpoint->host = intern(&checkpoints->hosts, &checkpoints->n_hosts,
+                                  store_host(store));
+        checkpoint->kernel = intern(&checkpoints->kernels,
+                                    &checkpoints->n_kernels,
+                                    store_kernel(store));
+    }
+    mpz_clear(w);
+
+    size_t capacity = 0;
+    size_t pending_capacity = 0;
+    struct interval interval;
+    int pending;
+    while (ret >= 0 && (ret = store_next_validated(store, &interval.from_i,
+                                                   &interval.to_i,
+                                                   &pending)) > 0) {
+        if (pending) {
+            ret = push_interval(&checkpoints->pending,
+                                &checkpoints->n_pending, &pending_capacity,
+                                interval);
+        } else {
+            ret = push_interval(&checkpoints->validated,
+                                &checkpoints->n_validated, &capacity,
+                                interval);
+        }
+    }
+
+    store_close(store);
+    return ret;
+}
+
+static int compare_checkpoint(const void* a, const void* b) {
+    // increasing order of i
+    uint64_t ia = ((const struct checkpoint*) a)->i;
+    uint64_t ib = ((const struct checkpoint*) b)->i;
+    return (ia > ib) - (ia < ib);
+}
+
+static int same_puzzle(const struct stream* stream,
+                       const struct checkpoints* checkpoints) {
+    /* Whether a stream is for the puzzle of the loaded checkpoints; version 1
+     * streams do not tell */
+    mpz_t n, c;
+    mpz_init(n);
+    mpz_init(c);
+    uint64_t t;
+    int same = stream_parameters(stream, n, c, &t) == 0 ||
+               (mpz_cmp(n, checkpoints->n) == 0 &&
+                mpz_cmp(c, checkpoints->c) == 0 && t == checkpoints->t);
+    mpz_clear(c);
+    mpz_clear(n);
+    return same;
+}
+
+static int load_stream(struct checkpoints* checkpoints, const char* filename,
+                       int first) {
+    /* Merge the states logged in a stream with the loaded checkpoints
+     *
+     * The first source sets the puzzle; a stream added afterwards must be
+     * for the same one. When both have a value for the same i, the loaded
+     * one is kept. */
+    struct stream* stream = stream_open(filename);
+    if (stream == NULL) {
+        return -1;
+    }
+    if (first) {
+        stream_parameters(stream, checkpoints->n, checkpoints->c,
+                          &checkpoints->t);
+    } else if (!same_puzzle(stream, checkpoints)) {
+        LOG(WARN, "%s holds states of another puzzle", filename);
+        stream_close(stream);
+        return -1;
+    }
+
+    size_t n_loaded = checkpoints->count;
+    int ret;
+    uint64_t i;
+    mpz_t w;
+    mpz_init(w);
+    while ((ret = stream_next(stream, &i, w)) > 0) {
+        if (checkpoints_push(checkpoints, i, w) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+    mpz_clear(w);
+    stream_close(stream);
+    if (ret < 0) {
+        return -1;
+    }
+
+    // the stream is in the order of computation, which may go back
+    struct checkpoint* added = checkpoints->items + n_loaded;
+    size_t n_added = checkpoints->count - n_loaded;
+    qsort(added, n_added, sizeof(*added), compare_checkpoint);
+
+    struct checkpoint* items = malloc(checkpoints->capacity * sizeof(*items));
+    if (items == NULL) {
+        LOG(WARN, "could not allocate memory (%s)", strerror(errno));
+        return -1;
+    }
+    size_t count = 0;
+    size_t a = 0;
+    size_t b = 0;
+    while (a < n_loaded || b < n_added) {
+        // on ties, the loaded checkpoint comes first
+        if (b == n_added ||
+                (a < n_loaded && checkpoints->items[a].i <= added[b].i)) {
+            items[count] = checkpoints->items[a];
+            count += 1;
+            a += 1;
+            continue;
+        }
+        const struct checkpoint* last = count == 0 ? NULL : &items[count-1];
+        if (last != NULL && last->i == added[b].i) {
+            if (mpz_cmp(last->w, added[b].w) != 0) {
+                LOG(WARN, "%s disagrees at %#.12" PRIx64, filename, last->i);
+            }
+            mpz_clear(added[b].w);
+        } else {
+            items[count] = added[b];
+            count += 1;
+        }
+        b += 1;
+    }
+    free(checkpoints->items);
+    checkpoints->items = items;
+    checkpoints->count = count;
+    return 0;
+}
+
+extern struct checkpoints* checkpoints_load(const char* filename) {
+    /* Load all checkpoints of a database, a bundle or a stream in memory */
+    struct checkpoints* checkpoints = calloc(1, sizeof(*checkpoints));
+    struct session* session = session_new();
+    if (checkpoints == NULL || session == NULL) {
+        free(checkpoints);
+        if (session != NULL) {
+            session_delete(session);
+        }
+        return NULL;
+    }
+    // the parameters of LCS35, unless the source holds a test puzzle
+    mpz_init_set(checkpoints->n, session->n);
+    mpz_init_set(checkpoints->c, session->c);
+    checkpoints->t = session->t;
+    session_delete(session);
+
+    int ret;
+    if (bundle_probe(filename)) {
+        checkpoints->from_bundle = 1;
+        ret = load_bundle(checkpoints, filename);
+    } else if (stream_probe(filename)) {
+        checkpoints->from_bundle = 1;
+        ret = load_stream(checkpoints, filename, 1);
+    } else {
+        ret = load_database(checkpoints, filename);
+    }
+    if (ret < 0) {
+        LOG(WARN, "failed to load checkpoints from %s", filename);
+        checkpoints_delete(checkpoints);
+        return NULL;
+    }
+
+    return checkpoints;
+}
+
+extern int checkpoints_add_stream(struct checkpoints* checkpoints,
+                                  const char* filename) {
+    /* Merge the states logged in a stream of the same puzzle */
+    return load_stream(checkpoints, filename, 0);
+}
+
+extern int checkpoints_same_kernel(const struct checkpoints* checkpoints,
+                                   size_t k, const char* kernel) {
+    /* Whether checkpoint k is known to have been computed by kernel */
+    int index = checkpoints->items[k].kernel;
+    return index >= 0 && strcmp(checkpoints->kernels[index], kernel) == 0;
+}
+
+extern int checkpoints_validated(const struct checkpoints* checkpoints,
+                                 uint64_t from_i, uint64_t to_i) {
+    /* Whether a chain of validated intervals covers exactly from_i to to_i
+     *
+     * The chain might go through checkpoints that were since removed by
+     * compact; it must not overshoot to_i. */
+    const struct interval* validated = checkpoints->validated;
+    size_t n = checkpoints->n_validated;
+    uint64_t i = from_i;
+    while (i < to_i) {
+        // first interval starting at i
+        size_t low = 0;
+        size_t high = n;
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (validated[mid].from_i < i) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+
+        // take the longest one that does not overshoot
+        uint64_t next_i = i;
+        for (size_t k = low; k < n && validated[k].from_i == i; k += 1) {
+            if (validated[k].to_i <= to_i && validated[k].to_i > next_i) {
+                next_i = validated[k].to_i;
+            }
+        }
+        if (next_i == i) {
+            return 0;
+        }
+        i = next_i;
+    }
+    return 1;
+}
+
+extern int checkpoints_pending(const struct checkpoints* checkpoints,
+                               uint64_t from_i, uint64_t to_i) {
+    /* Whether from_i to to_i was recomputed up to a sub-checkpoint, with the
+     * result depending on the interval that continues from to_i */
+    const struct interval* pending = checkpoints->pending;
+    size_t low = 0;
+    size_t high = checkpoints->n_pending;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (pending[mid].from_i < from_i ||
+                (pending[mid].from_i == from_i && pending[mid].to_i < to_i)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low < checkpoints->n_pending && pending[low].from_i == from_i &&
+           pending[low].to_i == to_i;
+}
+
+extern void checkpoints_delete(struct checkpoints* checkpoints) {
+    for (size_t k = 0; k < checkpoints->count; k += 1) {
+        mpz_clear(checkpoints->items[k].w);
+    }
+    for (size_t k = 0; k < checkpoints->n_hosts; k += 1) {
+        free(checkpoints->hosts[k]);
+    }
+    free(checkpoints->hosts);
+    for (size_t k = 0; k < checkpoints->n_kernels; k += 1) {
+        free(checkpoints->kernels[k]);
+    }
+    free(checkpoints->kernels);
+    free(checkpoints->pending);
+    free(checkpoints->validated);
+    free(checkpoints->items);
+    mpz_clear(checkpoints->c);
+    mpz_clear(checkpoints->n);
+    free(checkpoints);
+}
@@ -0,0 +1,63 @@
+#ifndef CHECKPOINTS_H
+#define CHECKPOINTS_H
+
+// external libraries
+#include <gmp.h>
+
+// C99
+#include <stdint.h>
+
+// C90
+#include <stddef.h>
+
+struct checkpoint {
+    uint64_t i;
+    mpz_t w;
+    int host;  // index in hosts of the worker that produced it, -1 if unknown
+    int kernel;  // index in kernels of the implementation, -1 if unknown
+};
+
+struct interval {
+    uint64_t from_i;
+    uint64_t to_i;
+};
+
+/* All checkpoints of a database, a bundle or a stream, in increasing order
+ * of i, along with the intervals already validated and those recomputed up
+ * to a sub-checkpoint whose result is still pending (databases only) */
+struct checkpoints {
+    // puzzle the checkpoints belong to: LCS35 itself unless the source
+    // records a test puzzle
+    mpz_t n;
+    mpz_t c;
+    uint64_t t;
+    struct checkpoint* items;
+    size_t count;
+    size_t capacity;
+    int from_bundle;  // loaded from a bundle or a stream, not a database
+    struct interval* validated;  // by increasing from_i
+    size_t n_validated;
+    struct interval* pending;  // by increasing from_i
+    size_t n_pending;
+    char** hosts;
+    size_t n_hosts;
+    char** kernels;
+    size_t n_kernels;
+};
+
+extern struct checkpoints* checkpoints_load(const char* filename);
+extern void checkpoints_delete(struct checkpoints* checkpoints);
+extern int checkpoints_add_stream(struct checkpoints* checkpoints,
+                                  const char* filename);
+
+extern int checkpoints_same_kernel(const struct checkpoints* checkpoints,
+                                   size_t k, const char* kernel);
+extern int checkpoints_validated(const struct checkpoints* checkpoints,
+                                 uint64_t from_i, uint64_t to_i);
+extern int checkpoints_pending(const struct checkpoints* checkpoints,
+                               uint64_t from_i, uint64_t to_i);
+
+extern int checkpoints_push(struct checkpoints* checkpoints, uint64_t i,
+                            const mpz_t w);
+
+#endif
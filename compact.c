@@ -0,0 +1,177 @@
+#include "store.h"
+#include "util.h"
+
+// external libraries
+#include <sqlite3.h>
+
+// C99
+#include <inttypes.h>
+
+// C90
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Retention policy
+ *
+ * Checkpoints less than DENSE_WINDOW squarings behind the most recent one are
+ * all kept. Further back, the spacing between kept checkpoints doubles each
+ * time the age doubles: between 1 and 2 windows, only multiples of 2^26 are
+ * kept, between 2 and 4 windows, multiples of 2^27, and so on.
+ *
+ * Only confirmed checkpoints are ever dropped: those at the end of an
+ * interval that the validation table records as recomputed and matched,
+ * including the sub-checkpoints that validate derived once the rest of their
+ * interval matched. last_computed is no proof: validate used to bump it
+ * whether or not the interval matched. Databases validated before the
+ * validation table existed are thus left as they are until validate is run
+ * on them again. The first and the last checkpoints are always kept, so that
+ * resume and validate keep working on a compacted database; validate only
+ * sees longer intervals, and skips those that chain together intervals it
+ * already validated. */
+#define DENSE_WINDOW (1ull << 35)
+#define BASE_SPACING_LOG2 25
+
+static int keep_checkpoint(uint64_t i, uint64_t last_i) {
+    uint64_t age = last_i - i;
+    if (age < DENSE_WINDOW) {
+        return 1;
+    }
+
+    // level = floor(log2(age / DENSE_WINDOW)) + 1
+    unsigned level = 1;
+    for (uint64_t windows = age / DENSE_WINDOW; windows > 1; windows >>= 1) {
+        level += 1;
+    }
+    unsigned spacing_log2 = BASE_SPACING_LOG2 + level;
+    if (spacing_log2 >= 64) {
+        return 0;
+    }
+    return i % (1ull << spacing_log2) == 0;
+}
+
+static int compact(sqlite3* db, int dry_run) {
+    // find most recent checkpoint
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT MIN(i), MAX(i) FROM checkpoint", -1,
+                           &stmt, NULL) != SQLITE_OK) {
+        LOG(WARN, "sqlite3_prepare_v2: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(db));
+        sqlite3_finalize(stmt);
+        return -1;
+    }
+    uint64_t first_i = (uint64_t) sqlite3_column_int64(stmt, 0);
+    uint64_t last_i = (uint64_t) sqlite3_column_int64(stmt, 1);
+    sqlite3_finalize(stmt);
+
+    sqlite3_stmt* stmt_select;
+    if (sqlite3_prepare_v2(db,
+            "SELECT i, i IN (SELECT to_i FROM validation WHERE result = 1) "
+            "FROM checkpoint ORDER BY i", -1, &stmt_select, NULL)
+            != SQLITE_OK) {
+        LOG(WARN, "sqlite3_prepare_v2: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    sqlite3_stmt* stmt_delete;
+    if (sqlite3_prepare_v2(db, "DELETE FROM checkpoint WHERE i = ?", -1,
+                           &stmt_delete, NULL) != SQLITE_OK) {
+        LOG(WARN, "sqlite3_prepare_v2: %s", sqlite3_errmsg(db));
+        sqlite3_finalize(stmt_select);
+        return -1;
+    }
+
+    if (sqlite3_exec(db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK) {
+        LOG(WARN, "sqlite3_exec: %s", sqlite3_errmsg(db));
+        sqlite3_finalize(stmt_delete);
+        sqlite3_finalize(stmt_select);
+        return -1;
+    }
+
+    uint64_t n_kept = 0;
+    uint64_t n_dropped = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt_select)) == SQLITE_ROW) {
+        uint64_t i = (uint64_t) sqlite3_column_int64(stmt_select, 0);
+        int confirmed = sqlite3_column_int(stmt_select, 1);
+        if (!confirmed || i == first_i || i == last_i ||
+                keep_checkpoint(i, last_i)) {
+            n_kept += 1;
+            continue;
+        }
+
+        n_dropped += 1;
+        if (dry_run) {
+            continue;
+        }
+        sqlite3_bind_int64(stmt_delete, 1, (sqlite_int64) i);
+        rc = sqlite3_step(stmt_delete);
+        sqlite3_reset(stmt_delete);
+        if (rc != SQLITE_DONE) {
+            break;
+        }
+    }
+    if (rc != SQLITE_DONE) {
+        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(db));
+    }
+    // statements must be finalized before the transaction ends
+    sqlite3_finalize(stmt_delete);
+    sqlite3_finalize(stmt_select);
+    if (rc != SQLITE_DONE) {
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+        return -1;
+    }
+
+    if (sqlite3_exec(db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+        LOG(WARN, "sqlite3_exec: %s", sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+        return -1;
+    }
+
+    printf("%s %" PRIu64 " checkpoints, kept %" PRIu64 "\n",
+           dry_run ? "would drop" : "dropped", n_dropped, n_kept);
+
+    // rewrite the database file to actually release the space
+    if (!dry_run && n_dropped > 0) {
+        if (sqlite3_exec(db, "VACUUM", NULL, NULL, NULL) != SQLITE_OK) {
+            LOG(WARN, "sqlite3_exec: %s", sqlite3_errmsg(db));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+extern int main(int argc, char** argv) {
+    // parse arguments
+    parse_debug_args(&argc, argv);
+    int dry_run = 0;
+    if (argc == 3 && (strcmp(argv[1], "-n") == 0 ||
+                      strcmp(argv[1], "--dry-run") == 0)) {
+        dry_run = 1;
+        argv[1] = argv[2];
+        argc -= 1;
+    }
+    if (argc != 2) {
+        LOG(FATAL, "usage: %s [--dry-run] savefile.db", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    // the store makes sure that all tables exist
+    struct store* store = store_open_existing(argv[1], 1);
+    if (store == NULL) {
+        LOG(FATAL, "failed to open %s", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (compact(store->db, dry_run) < 0) {
+        LOG(FATAL, "failed to compact %s", argv[1]);
+        store_close(store);
+        exit(EXIT_FAILURE);
+    }
+
+    store_close(store);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,70 @@
+#include "deque.h" // source header
+
+// C90
+#include <stdlib.h>
+
+extern int deque_init(struct deque* deque, size_t capacity) {
+    deque->top = 0;
+    deque->bottom = 0;
+    deque->capacity = capacity == 0 ? 1 : capacity;
+    deque->tasks = malloc(deque->capacity * sizeof(*deque->tasks));
+    return deque->tasks == NULL ? -1 : 0;
+}
+
+extern void deque_destroy(struct deque* deque) {
+    free(deque->tasks);
+}
+
+extern void deque_push(struct deque* deque, size_t task) {
+    /* Owner only: add a task at the bottom */
+    int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    deque->tasks[(size_t) b % deque->capacity] = task;
+    __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+extern enum deque_status deque_pop(struct deque* deque, size_t* task) {
+    /* Owner only: take the most recently pushed task */
+    int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if (t > b) {
+        // empty
+        __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+        return DEQUE_EMPTY;
+    }
+
+    *task = deque->tasks[(size_t) b % deque->capacity];
+    if (t < b) {
+        // more than one task left, no thief can reach this one
+        return DEQUE_TASK;
+    }
+
+    // last task: race against thieves for it
+    enum deque_status status = DEQUE_TASK;
+    if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        status = DEQUE_EMPTY;
+    }
+    __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+    return status;
+}
+
+extern enum deque_status deque_steal(struct deque* deque, size_t* task) {
+    /* Any thread: take the least recently pushed task */
+    int64_t t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+    if (t >= b) {
+        return DEQUE_EMPTY;
+    }
+
+    *task = deque->tasks[(size_t) t % deque->capacity];
+    if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return DEQUE_ABORT;
+    }
+    return DEQUE_TASK;
+}
@@ -0,0 +1,36 @@
+#ifndef DEQUE_H
+#define DEQUE_H
+
+// C99
+#include <stdint.h>
+
+// C90
+#include <stddef.h>
+
+/* Lock-free work-stealing deque (Chase and Lev, 2005)
+ *
+ * The owner thread pushes and pops tasks at the bottom; other threads steal
+ * them from the top. Tasks are indices into an array held by the caller. The
+ * capacity is fixed and must not be exceeded. */
+struct deque {
+    // top and bottom live in separate cache lines; thieves only write top
+    int64_t top __attribute__((aligned(64)));
+    int64_t bottom __attribute__((aligned(64)));
+    size_t* tasks __attribute__((aligned(64)));
+    size_t capacity;
+};
+
+enum deque_status {
+    DEQUE_EMPTY,
+    DEQUE_TASK,
+    DEQUE_ABORT,  // lost a race against another thread; try again
+};
+
+extern int deque_init(struct deque* deque, size_t capacity);
+extern void deque_destroy(struct deque* deque);
+
+extern void deque_push(struct deque* deque, size_t task);
+extern enum deque_status deque_pop(struct deque* deque, size_t* task);
+extern enum deque_status deque_steal(struct deque* deque, size_t* task);
+
+#endif
@@ -0,0 +1,277 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "duo.h" // source header
+
+// local includes
+#include "util.h"
+
+// POSIX
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+
+// C90
+#include <stdlib.h>
+#include <string.h>
+
+// limbs of q published together; fewer exchanges of the cache line
+#define DUO_BATCH 4
+// spins before yielding the CPU, when the threads may have a core each
+#define DUO_MAX_SPINS 1024
+
+__extension__ typedef unsigned __int128 u128;
+
+static void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static void wait_until(struct duo* duo, const uint64_t* counter,
+                       uint64_t value) {
+    /* Spin until *counter reaches value (or the helper is stopped); yield now
+     * and then, in case both threads share a core */
+    unsigned spins = 0;
+    while (__atomic_load_n(counter, __ATOMIC_ACQUIRE) < value &&
+           !__atomic_load_n(&duo->stop, __ATOMIC_ACQUIRE)) {
+        spins += 1;
+        if (spins % duo->max_spins == 0) {
+            sched_yield();
+        } else {
+            cpu_relax();
+        }
+    }
+}
+
+static void add_product(uint64_t* column, u128 p) {
+    /* Add p to a column held in 3 limbs */
+    u128 s = ((u128) column[1] << 64 | column[0]) + p;
+    column[0] = (uint64_t) s;
+    column[1] = (uint64_t) (s >> 64);
+    column[2] += s < p;
+}
+
+static void low_half(struct duo* duo, uint64_t g) {
+    /* Columns 0 to n-1 of squaring g, which give q; run by the caller */
+    const size_t n = duo->n_limbs;
+    const uint64_t* x = duo->x;
+    const uint64_t* m = duo->modulus;
+    uint64_t* q = duo->q;
+    uint64_t base = g * n;
+
+    u128 acc = 0;
+    uint64_t acc_high = 0;
+    for (size_t k = 0; k < n; k += 1) {
+        // x_i x_j with i < j, counted twice, and x_(k/2)^2
+        u128 cross = 0;
+        uint64_t cross_high = 0;
+        for (size_t i = 0; 2 * i < k; i += 1) {
+            u128 p = (u128) x[i] * x[k-i];
+            cross += p;
+            cross_high += cross < p;
+        }
+        u128 doubled = cross << 1;
+        acc += doubled;
+        acc_high += (cross_high << 1 | (uint64_t) (cross >> 127)) +
+                    (acc < doubled);
+        if (k % 2 == 0) {
+            u128 p = (u128) x[k/2] * x[k/2];
+            acc += p;
+            acc_high += acc < p;
+        }
+
+        // q_j m_(k-j), then q_k to cancel the low limb of the column
+        for (size_t j = 0; j < k; j += 1) {
+            u128 p = (u128) q[j] * m[k-j];
+            acc += p;
+            acc_high += acc < p;
+        }
+        q[k] = (uint64_t) acc * duo->inverse;
+        u128 p = (u128) q[k] * m[0];
+        acc += p;
+        acc_high += acc < p;
+        acc = acc >> 64 | (u128) acc_high << 64;
+        acc_high = 0;
+
+        if (k == n - 1) {
+            duo->carry[0] = (uint64_t) acc;
+            duo->carry[1] = (uint64_t) (acc >> 64);
+        }
+        if ((k + 1) % DUO_BATCH == 0 || k == n - 1) {
+            __atomic_store_n(&duo->published, base + k + 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+static void high_half(struct duo* duo, uint64_t g) {
+    /* Columns n to 2n-1 of squaring g, then the next x; run by the helper */
+    const size_t n = duo->n_limbs;
+    uint64_t* x = duo->x;
+    const uint64_t* m = duo->modulus;
+    const uint64_t* q = duo->q;
+    uint64_t* high = duo->high;
+    uint64_t base = g * n;
+    memset(high, 0, 3 * n * sizeof(*high));
+
+    // x_i x_j, which do not depend on q
+    for (size_t k = n; k < 2 * n - 1; k += 1) {
+        uint64_t cross[3] = {0, 0, 0};
+        for (size_t i = k - n + 1; 2 * i < k; i += 1) {
+            add_product(cross, (u128) x[i] * x[k-i]);
+        }
+        uint64_t* column = &high[3 * (k - n)];
+        add_product(column, (u128) cross[1] << 65 | (u128) cross[0] << 1);
+        column[2] += cross[2] << 1 | cross[1] >> 63;
+        if (k % 2 == 0) {
+            add_product(column, (u128) x[k/2] * x[k/2]);
+        }
+    }
+
+    // q_j m_i with i + j >= n, as soon as q_j is published
+    size_t available = 0;
+    for (size_t j = 0; j < n; j += 1) {
+        if (j == available) {
+            wait_until(duo, &duo->published, base + j + 1);
+            available = (size_t) (__atomic_load_n(&duo->published,
+                                                  __ATOMIC_ACQUIRE) - base);
+            if (__atomic_load_n(&duo->stop, __ATOMIC_ACQUIRE)) {
+                return;
+            }
+        }
+        for (size_t i = n - j; i < n; i += 1) {
+            add_product(&high[3 * (j + i - n)], (u128) q[j] * m[i]);
+        }
+    }
+
+    // carry out of the low half, then normalize; the caller is done with x
+    u128 acc = (u128) duo->carry[1] << 64 | duo->carry[0];
+    uint64_t acc_high = 0;
+    for (size_t c = 0; c < n; c += 1) {
+        u128 column = (u128) high[3*c+1] << 64 | high[3*c];
+        acc += column;
+        acc_high += high[3*c+2] + (acc < column);
+        x[c] = (uint64_t) acc;
+        acc = acc >> 64 | (u128) acc_high << 64;
+        acc_high = 0;
+    }
+    __atomic_store_n(&duo->done, g + 1, __ATOMIC_RELEASE);
+}
+
+static void* helper_thread(void* argument) {
+    struct duo* duo = argument;
+    uint64_t g = 0;
+    while (1) {
+        wait_until(duo, &duo->target, g + 1);
+        if (__atomic_load_n(&duo->stop, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        high_half(duo, g);
+        g += 1;
+    }
+    return NULL;
+}
+
+extern struct duo* duo_new(const mpz_t modulus) {
+    /* Start the helper thread; modulus must be odd */
+    if (mpz_even_p(modulus)) {
+        return NULL;
+    }
+    struct duo* duo;
+    if (posix_memalign((void**) &duo, 64, sizeof(*duo)) != 0) {
+        return NULL;
+    }
+    memset(duo, 0, sizeof(*duo));
+
+    // values lower than 2*modulus stay so through squarings if 4*modulus < R
+    size_t n = (mpz_sizeinbase(modulus, 2) + 2 + 63) / 64;
+    duo->n_limbs = n;
+    duo->modulus = calloc(n, sizeof(*duo->modulus));
+    duo->x = calloc(n, sizeof(*duo->x));
+    duo->q = calloc(n, sizeof(*duo->q));
+    duo->high = calloc(3 * n, sizeof(*duo->high));
+    if (duo->modulus == NULL || duo->x == NULL || duo->q == NULL ||
+            duo->high == NULL) {
+        goto fail;
+    }
+    mpz_export(duo->modulus, NULL, -1, sizeof(*duo->modulus), 0, 0, modulus);
+
+    // Newton's iteration doubles the number of correct low bits each time
+    uint64_t m0 = duo->modulus[0];
+    uint64_t inverse = m0;  // correct modulo 2^3 for odd m0
+    for (int k = 0; k < 5; k += 1) {
+        inverse *= 2 - m0 * inverse;
+    }
+    duo->inverse = -inverse;
+
+    mpz_init_set(duo->mpz_modulus, modulus);
+    mpz_init_set_ui(duo->r_inverse, 1);
+    mpz_mul_2exp(duo->r_inverse, duo->r_inverse, 64 * n);
+    mpz_invert(duo->r_inverse, duo->r_inverse, modulus);
+
+    // with one CPU, the other thread can only progress if this one yields
+    duo->max_spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? DUO_MAX_SPINS : 1;
+
+    // signals are for the caller
+    sigset_t set, old_set;
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, &old_set);
+    int ret = pthread_create(&duo->thread, NULL, helper_thread, duo);
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+    if (ret != 0) {
+        LOG(WARN, "failed to start thread (%s)", strerror(ret));
+        mpz_clear(duo->r_inverse);
+        mpz_clear(duo->mpz_modulus);
+        goto fail;
+    }
+    return duo;
+
+fail:
+    free(duo->high);
+    free(duo->q);
+    free(duo->x);
+    free(duo->modulus);
+    free(duo);
+    return NULL;
+}
+
+extern void duo_delete(struct duo* duo) {
+    __atomic_store_n(&duo->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(duo->thread, NULL);
+    mpz_clear(duo->r_inverse);
+    mpz_clear(duo->mpz_modulus);
+    free(duo->high);
+    free(duo->q);
+    free(duo->x);
+    free(duo->modulus);
+    free(duo);
+}
+
+extern void duo_set(struct duo* duo, const mpz_t w) {
+    /* Load w, converting it to Montgomery form (w * R) */
+    size_t n = duo->n_limbs;
+    mpz_t tmp;
+    mpz_init(tmp);
+    mpz_mul_2exp(tmp, w, 64 * n);
+    mpz_mod(tmp, tmp, duo->mpz_modulus);
+    memset(duo->x, 0, n * sizeof(*duo->x));
+    mpz_export(duo->x, NULL, -1, sizeof(*duo->x), 0, 0, tmp);
+    mpz_clear(tmp);
+}
+
+extern void duo_get(const struct duo* duo, mpz_t w) {
+    /* Read the current value in normal form */
+    mpz_import(w, duo->n_limbs, -1, sizeof(*duo->x), 0, 0, duo->x);
+    mpz_mul(w, w, duo->r_inverse);
+    mpz_mod(w, w, duo->mpz_modulus);
+}
+
+extern void duo_work(struct duo* duo, uint64_t amount) {
+    /* Square amount times, with the helper thread */
+    uint64_t g = __atomic_load_n(&duo->target, __ATOMIC_RELAXED);
+    __atomic_store_n(&duo->target, g + amount, __ATOMIC_RELEASE);
+    for (uint64_t s = 0; s < amount; s += 1) {
+        wait_until(duo, &duo->done, g + s);
+        low_half(duo, g + s);
+    }
+    wait_until(duo, &duo->done, g + amount);
+}
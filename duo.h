@@ -0,0 +1,57 @@
+#ifndef DUO_H
+#define DUO_H
+
+// external libraries
+#include <gmp.h>
+
+// POSIX
+#include <pthread.h>
+
+// C99
+#include <stdint.h>
+
+// C90
+#include <stddef.h>
+
+// name of the implementation of duo_work()
+#define DUO_KERNEL "duo-montgomery"
+
+/* Experimental: one chain of squarings computed by two cooperating threads
+ *
+ * Each Montgomery squaring x^2 / R mod modulus is split by columns. The
+ * calling thread computes the low half, which determines the quotient q one
+ * limb at a time; a helper thread computes the high half of x^2 and adds
+ * q_j * modulus to it as soon as q_j is published. The helper then folds in
+ * the carry out of the low half and writes the next x.
+ *
+ * The threads only exchange data through counters in their own cache lines,
+ * on which the other thread spins; both threads should run on cores sharing
+ * an L2 cache. x is kept in Montgomery form, in [0, 2*modulus). */
+struct duo {
+    size_t n_limbs;
+    uint64_t inverse;  // -modulus^-1 mod 2^64
+    uint64_t* modulus;
+    uint64_t* x;  // written by the helper, between squarings
+    uint64_t* q;  // written by the caller
+    uint64_t* high;  // columns n to 2n-1, as 3 limbs each (helper only)
+    uint64_t carry[2];  // out of the low half, published with the last q
+    mpz_t mpz_modulus;
+    mpz_t r_inverse;  // 2^(-64 n_limbs) mod modulus
+    pthread_t thread;
+    unsigned max_spins;  // before yielding; 1 when there is a single CPU
+
+    // counters, each written by a single thread
+    uint64_t published __attribute__((aligned(64)));  // n per squaring
+    uint64_t done __attribute__((aligned(64)));  // squarings completed
+    uint64_t target __attribute__((aligned(64)));  // squarings requested
+    int stop;
+};
+
+extern struct duo* duo_new(const mpz_t modulus);
+extern void duo_delete(struct duo* duo);
+
+extern void duo_set(struct duo* duo, const mpz_t w);
+extern void duo_get(const struct duo* duo, mpz_t w);
+extern void duo_work(struct duo* duo, uint64_t amount);
+
+#endif
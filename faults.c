@@ -0,0 +1,727 @@
+#define _POSIX_C_SOURCE 200809L
+
+// local includes
+#include "build.h"
+#include "session.h"
+#include "socket.h"
+#include "store.h"
+#include "time.h"
+#include "util.h"
+
+// external libraries
+#include <sqlite3.h>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// C99
+#include <inttypes.h>
+
+// C90
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// where supervisor.py listens
+#define SUPERVISOR_HOST "localhost"
+#define SUPERVISOR_PORT "4242"
+
+/* Fault injection
+ *
+ * Each trial runs one save period of work (2^save squarings, starting from a
+ * checkpoint held by the supervisor) and injects a single fault at a random
+ * squaring. The corrupted computation goes on with session_check() every
+ * 2^check squarings, as work does; when a check fails, work stops and is
+ * restarted from the last checkpoint.
+ *
+ * Beyond work, the tools that ship are run rather than copies of their
+ * checks: save frames are sent to supervisor.py, started on a temporary test
+ * puzzle, and whatever corrupted checkpoint gets stored is left to validate,
+ * run on that database. Since the supervisor listens on a fixed port, no
+ * other one may run on this host meanwhile. */
+
+enum site {
+    SITE_W,  // w between two squarings
+    SITE_SCRATCH,  // product w*w before its reduction
+    SITE_FRAME,  // "save:i:w:kernel:build" message sent to the supervisor
+    N_SITES,
+};
+
+static const char* site_names[N_SITES] = {"w", "scratch", "frame"};
+
+struct report {
+    uint64_t n_faults;
+    uint64_t by_work;  // session_check() in work
+    uint64_t by_supervisor;  // rejected, or reported invalid by check()
+    uint64_t by_validate;  // stored, then reported invalid by validate
+    uint64_t missed;  // stored and accepted by validate
+    uint64_t masked;  // no effect on the saved checkpoint
+    uint64_t latency;  // squarings from fault to online detection
+    uint64_t lost;  // squarings computed again after online detection
+    // validate starts once the checkpoint is saved; work goes on meanwhile
+    double validate_latency;  // squarings from fault to the end of validate
+    double validate_lost;  // squarings of work since the last good checkpoint
+};
+
+struct harness {
+    /* argv[0], to find validate and supervisor.py */
+    const char* tool_path;
+    /* test puzzle with the modulus and control prime of the trials */
+    char filename[256];
+    /* supervisor.py, or 0 when it is not running */
+    pid_t supervisor;
+    /* read end of a pipe from the standard output of the supervisor */
+    int output;
+    uint64_t period;
+    /* of work, to count the time taken by validate in squarings */
+    double squaring_rate;
+};
+
+// global so that the supervisor is stopped on any exit
+static struct harness harness;
+
+static uint64_t next_random(uint64_t* state) {
+    /* splitmix64 */
+    *state += 0x9e3779b97f4a7c15;
+    uint64_t z = *state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+static void corrupt(mpz_t x, size_t bits, int word, uint64_t* seed) {
+    /* Flip a random bit among the first bits of x, or overwrite a random
+     * 64-bit word with random data */
+    if (!word) {
+        mpz_combit(x, next_random(seed) % bits);
+        return;
+    }
+    size_t offset = (next_random(seed) % ((bits + 63) / 64)) * 64;
+    uint64_t value = next_random(seed);
+    for (size_t k = 0; k < 64; k += 1) {
+        if ((value >> k) & 1) {
+            mpz_setbit(x, offset + k);
+        } else {
+            mpz_clrbit(x, offset + k);
+        }
+    }
+}
+
+static void tool(const char* name, char* path, size_t size) {
+    /* Path to a file of the project, found next to this tool */
+    const char* slash = strrchr(harness.tool_path, '/');
+    int length = slash == NULL ? 0 : (int) (slash - harness.tool_path + 1);
+    snprintf(path, size, "%.*s%s", length, harness.tool_path, name);
+}
+
+static void remove_database(const char* filename) {
+    /* Remove a database along with its WAL files */
+    char path[300];
+    remove(filename);
+    snprintf(path, sizeof(path), "%s-wal", filename);
+    remove(path);
+    snprintf(path, sizeof(path), "%s-shm", filename);
+    remove(path);
+}
+
+static int create_puzzle(const struct session* session) {
+    /* Record the modulus and the control prime in a new database, as puzzle
+     * does, so that the supervisor and validate use them */
+    const char* tmpdir = getenv("TMPDIR");
+    snprintf(harness.filename, sizeof(harness.filename),
+             "%s/lcs35-faults-%ld.db", tmpdir != NULL ? tmpdir : "/tmp",
+             (long) getpid());
+    remove_database(harness.filename);
+    struct store* store = store_open(harness.filename, 1);
+    if (store == NULL) {
+        return -1;
+    }
+    int ret = store_set_parameters(store, session->n, session->c, session->t);
+    if (store_close(store) < 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+static int clear_puzzle(void) {
+    /* Remove the checkpoints and validations left by a trial */
+    struct store* store = store_open(harness.filename, 1);
+    if (store == NULL) {
+        return -1;
+    }
+    int ret = 0;
+    if (sqlite3_exec(store->db,
+            "DELETE FROM checkpoint; DELETE FROM validation", NULL, NULL,
+            NULL) != SQLITE_OK) {
+        LOG(WARN, "sqlite3_exec: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    }
+    if (store_close(store) < 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+static int save_checkpoint(uint64_t i, const mpz_t w) {
+    /* Store a checkpoint in the test puzzle, as the supervisor does */
+    struct store* store = store_open(harness.filename, 1);
+    if (store == NULL) {
+        return -1;
+    }
+    int ret = store_write(store, STORE_APPEND, i, w, SESSION_KERNEL);
+    if (store_close(store) < 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+static int last_checkpoint(uint64_t* i, mpz_t w) {
+    /* Read the checkpoint stored by the supervisor in the test puzzle
+     *
+     * returns 1 if a checkpoint was found
+     * returns 0 if there is no checkpoint
+     * returns -1 if an error was encountered */
+    struct store* store = store_open(harness.filename, 1);
+    if (store == NULL) {
+        return -1;
+    }
+    int ret = store_last(store, i, w);
+    if (store_close(store) < 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+static void stop_supervisor(void) {
+    /* Stop supervisor.py and remove the test puzzle (atexit handler) */
+    if (harness.supervisor > 0) {
+        kill(harness.supervisor, SIGTERM);
+        waitpid(harness.supervisor, NULL, 0);
+        close(harness.output);
+        harness.supervisor = 0;
+    }
+    if (harness.filename[0] != 0) {
+        remove_database(harness.filename);
+    }
+}
+
+static int start_supervisor(void) {
+    /* Run supervisor.py on the test puzzle and wait until it listens
+     *
+     * Its standard output tells which frames it reported invalid and which
+     * it stored; the tracebacks of the frames it rejects are discarded. */
+    int server = tcp_connect(SUPERVISOR_HOST, SUPERVISOR_PORT);
+    if (server >= 0) {
+        close(server);
+        LOG(WARN, "a supervisor already listens on port %s", SUPERVISOR_PORT);
+        return -1;
+    }
+
+    char path[4096];
+    tool("supervisor.py", path, sizeof(path));
+    int fds[2];
+    if (pipe(fds) < 0) {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    } else if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2(null, STDERR_FILENO);
+        }
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        execlp("python3", "python3", "-u", path, harness.filename,
+               (char*) NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+    harness.supervisor = pid;
+    harness.output = fds[0];
+    // only what was printed so far is read, never waited for
+    if (fcntl(harness.output, F_SETFL, O_NONBLOCK) < 0) {
+        return -1;
+    }
+
+    for (int k = 0; k < 100; k += 1) {
+        if (waitpid(pid, NULL, WNOHANG) != 0) {
+            harness.supervisor = 0;
+            close(harness.output);
+            LOG(WARN, "%s exited", path);
+            return -1;
+        }
+        server = tcp_connect(SUPERVISOR_HOST, SUPERVISOR_PORT);
+        if (server >= 0) {
+            close(server);
+            return 0;
+        }
+        struct timespec delay = {0, 100000000};
+        nanosleep(&delay, NULL);
+    }
+    LOG(WARN, "%s does not listen on port %s", path, SUPERVISOR_PORT);
+    return -1;
+}
+
+static char* read_output(void) {
+    /* What the supervisor printed since the last call, or NULL on error */
+    char* output = NULL;
+    size_t size = 0;
+    while (1) {
+        char* larger = realloc(output, size + 4096 + 1);
+        if (larger == NULL) {
+            free(output);
+            return NULL;
+        }
+        output = larger;
+        ssize_t n = read(harness.output, output + size, 4096);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            free(output);
+            return NULL;
+        } else if (n <= 0) {
+            break;
+        }
+        size += (size_t) n;
+    }
+    output[size] = 0;
+    return output;
+}
+
+static int send_frame(const char* frame, size_t length) {
+    /* Send a frame to the supervisor and wait until it has handled it
+     *
+     * work closes its connection right after the frame; closing only our
+     * side lets us see the supervisor close its own once it is done. */
+    int server = tcp_connect(SUPERVISOR_HOST, SUPERVISOR_PORT);
+    if (server < 0) {
+        return -1;
+    }
+    int ret = 0;
+    size_t sent = 0;
+    while (sent < length) {
+        ssize_t n = write(server, frame + sent, length - sent);
+        if (n < 0) {
+            ret = -1;
+            break;
+        }
+        sent += (size_t) n;
+    }
+    if (shutdown(server, SHUT_WR) < 0) {
+        ret = -1;
+    }
+    char buffer[256];
+    while (ret == 0) {
+        ssize_t n = read(server, buffer, sizeof(buffer));
+        if (n < 0) {
+            ret = -1;
+        } else if (n == 0) {
+            break;
+        }
+    }
+    if (close(server) < 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+static int run_validate(uint64_t i, double* seconds) {
+    /* Run validate on the test puzzle, where a checkpoint is stored at i
+     *
+     * returns 1 if validate accepted the interval ending at i
+     * returns 0 if it found the interval invalid
+     * returns -1 if an error was encountered */
+    char path[4096];
+    tool("validate", path, sizeof(path));
+    double start = real_clock();
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    } else if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2(null, STDOUT_FILENO);
+        }
+        execl(path, path, harness.filename, (char*) NULL);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0) {
+        LOG(WARN, "%s failed", path);
+        return -1;
+    }
+    *seconds = real_clock() - start;
+
+    // the result is read back from the validation table
+    struct store* store = store_open(harness.filename, 1);
+    if (store == NULL) {
+        return -1;
+    }
+    int ret = 0;
+    uint64_t from_i, to_i;
+    int pending;
+    int rc;
+    while ((rc = store_next_validated(store, &from_i, &to_i, &pending)) > 0) {
+        if (to_i == i && !pending) {
+            ret = 1;
+        }
+    }
+    if (rc < 0) {
+        ret = -1;
+    }
+    if (store_close(store) < 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+static void validate_fault(uint64_t i, uint64_t latency, uint64_t lost,
+                           int resumed, struct report* report) {
+    /* Let validate find the corrupted checkpoint stored at i
+     *
+     * latency and lost count the squarings up to the save; when work resumed
+     * from the corrupted w, all it computed while validate ran is lost too */
+    double seconds;
+    int ret = run_validate(i, &seconds);
+    if (ret < 0) {
+        LOG(FATAL, "failed to run validate");
+        exit(EXIT_FAILURE);
+    } else if (ret > 0) {
+        report->missed += 1;
+        return;
+    }
+    double meanwhile = seconds * harness.squaring_rate;
+    report->by_validate += 1;
+    report->validate_latency += (double) latency + meanwhile;
+    report->validate_lost += (double) lost + (resumed ? meanwhile : 0);
+}
+
+static void inject_compute(struct session* session, mpz_t* reference,
+                           unsigned check, enum site site, int word,
+                           uint64_t* seed, struct report* report) {
+    /* One fault in w or in the scratch product, during a save period */
+    uint64_t period = harness.period;
+    uint64_t fault = next_random(seed) % period;
+
+    // resume from the last verified block before the fault
+    session->t = period;
+    session->i = fault >> check << check;
+    mpz_set(session->w, reference[fault >> check]);
+    session_work(session, fault - session->i);
+
+    size_t bits = mpz_sizeinbase(session->n_times_c, 2);
+    if (site == SITE_W) {
+        corrupt(session->w, bits, word, seed);
+    } else {
+        mpz_t product;
+        mpz_init(product);
+        mpz_mul(product, session->w, session->w);
+        corrupt(product, 2 * bits, word, seed);
+        mpz_mod(session->w, product, session->n_times_c);
+        mpz_clear(product);
+        session->i += 1;
+    }
+
+    // carry on until the next failed check
+    report->n_faults += 1;
+    while (session->i < period) {
+        uint64_t next = ((session->i >> check) + 1) << check;
+        session_work(session, next - session->i);
+        if (session_check(session) != 0) {
+            report->by_work += 1;
+            report->latency += session->i - fault;
+            report->lost += session->i;
+            return;
+        }
+    }
+
+    if (mpz_cmp(session->w, reference[period >> check]) == 0) {
+        report->masked += 1;
+        return;
+    }
+
+    // the corrupted w is saved, and work goes on from it
+    if (save_checkpoint(period, session->w) < 0) {
+        LOG(FATAL, "failed to save checkpoint in %s", harness.filename);
+        exit(EXIT_FAILURE);
+    }
+    validate_fault(period, period - fault, period, 1, report);
+    if (clear_puzzle() < 0) {
+        LOG(FATAL, "failed to clear %s", harness.filename);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void inject_frame(const mpz_t w, int word, uint64_t* seed,
+                         struct report* report) {
+    /* One fault in the frame saving the checkpoint at the end of the period */
+    uint64_t period = harness.period;
+    char* str_w = mpz_get_str(NULL, 10, w);
+    char* frame;
+    if (str_w == NULL ||
+            asprintf(&frame, "save:%#" PRIx64 ":%s:%s:%s", period, str_w,
+                     SESSION_KERNEL, build_revision) < 0) {
+        LOG(FATAL, "could not allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    free(str_w);
+
+    // a fault in a word of the frame garbles 8 consecutive bytes
+    size_t length = strlen(frame);
+    if (word) {
+        size_t offset = next_random(seed) % length;
+        uint64_t value = next_random(seed);
+        for (size_t k = offset; k < offset + 8 && k < length; k += 1) {
+            frame[k] = (char) (value & 0xff);
+            value >>= 8;
+        }
+    } else {
+        uint64_t bit = next_random(seed) % (8 * length);
+        frame[bit / 8] = (char) (frame[bit / 8] ^ (1 << (bit % 8)));
+    }
+
+    // skip what the supervisor printed before this frame
+    free(read_output());
+    int ret = send_frame(frame, length);
+    free(frame);
+    char* output = ret < 0 ? NULL : read_output();
+    if (output == NULL) {
+        LOG(FATAL, "failed to send frame to the supervisor");
+        exit(EXIT_FAILURE);
+    }
+    // printed when check() fails, and once the checkpoint is stored
+    int invalid = strstr(output, "invalid (") != NULL;
+    int inserted = strstr(output, "inserted (") != NULL;
+    free(output);
+
+    // work still holds the genuine w, so nothing has to be computed again
+    report->n_faults += 1;
+    if (!inserted || invalid) {
+        report->by_supervisor += 1;
+    } else {
+        uint64_t i;
+        mpz_t stored;
+        mpz_init(stored);
+        if (last_checkpoint(&i, stored) <= 0) {
+            LOG(FATAL, "failed to read checkpoint from %s", harness.filename);
+            exit(EXIT_FAILURE);
+        }
+        if (i == period && mpz_cmp(stored, w) == 0) {
+            report->masked += 1;
+        } else {
+            validate_fault(i, 0, 0, 0, report);
+        }
+        mpz_clear(stored);
+    }
+    if (clear_puzzle() < 0) {
+        LOG(FATAL, "failed to clear %s", harness.filename);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static double check_cost(const struct session* session) {
+    /* Seconds per call to session_check() */
+    uint64_t n = 0;
+    double start = real_clock();
+    double elapsed;
+    do {
+        session_check(session);
+        n += 1;
+        elapsed = real_clock() - start;
+    } while (elapsed < 0.1);
+    return elapsed / (double) n;
+}
+
+static void usage(const char* name) {
+    LOG(FATAL, "usage: %s [--site w|scratch|frame] [--fault bit|word] "
+        "[--trials count] [--check log2] [--save log2] [--control-bits b] "
+        "[--rate faults_per_hour] [--seed n]", name);
+    exit(EXIT_FAILURE);
+}
+
+extern int main(int argc, char** argv) {
+    // parse arguments
+    parse_debug_args(&argc, argv);
+    int sites[N_SITES] = {1, 1, 1};
+    int word = 0;
+    uint64_t n_trials = 200;
+    unsigned long check = 12;
+    unsigned long save = 17;  // as in work, 32 checks per save
+    unsigned long control_bits = 0;  // keep the control prime of LCS35
+    double rate = 1;
+    uint64_t seed = 1;
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "--site") == 0) {
+            for (size_t k = 0; k < N_SITES; k += 1) {
+                sites[k] = strcmp(argv[arg+1], site_names[k]) == 0;
+            }
+        } else if (strcmp(argv[arg], "--fault") == 0) {
+            word = strcmp(argv[arg+1], "word") == 0;
+            if (!word && strcmp(argv[arg+1], "bit") != 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[arg], "--trials") == 0) {
+            n_trials = strtoull(argv[arg+1], NULL, 0);
+        } else if (strcmp(argv[arg], "--check") == 0) {
+            check = strtoul(argv[arg+1], NULL, 0);
+        } else if (strcmp(argv[arg], "--save") == 0) {
+            save = strtoul(argv[arg+1], NULL, 0);
+        } else if (strcmp(argv[arg], "--control-bits") == 0) {
+            control_bits = strtoul(argv[arg+1], NULL, 0);
+        } else if (strcmp(argv[arg], "--rate") == 0) {
+            rate = strtod(argv[arg+1], NULL);
+        } else if (strcmp(argv[arg], "--seed") == 0) {
+            seed = strtoull(argv[arg+1], NULL, 0);
+        } else {
+            usage(argv[0]);
+        }
+        arg += 2;
+    }
+    if (argc != arg || check > save || save >= 40 || control_bits == 1 ||
+            control_bits > 256) {
+        usage(argv[0]);
+    }
+    harness.tool_path = argv[0];
+
+    struct session* session = session_new();
+    if (session == NULL) {
+        LOG(FATAL, "could not allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    if (control_bits > 0) {
+        // random prime of exactly control_bits bits
+        mpz_set_ui(session->c, 0);
+        for (unsigned long k = 0; k + 1 < control_bits; k += 1) {
+            if (next_random(&seed) & 1) {
+                mpz_setbit(session->c, k);
+            }
+        }
+        mpz_setbit(session->c, control_bits - 1);
+        mpz_nextprime(session->c, session->c);
+        mpz_mul(session->n_times_c, session->n, session->c);
+    }
+
+    // the supervisor and validate work on a test puzzle with this control
+    // prime, which is removed on exit
+    atexit(stop_supervisor);
+    if (create_puzzle(session) < 0) {
+        LOG(FATAL, "failed to create %s", harness.filename);
+        exit(EXIT_FAILURE);
+    }
+    if (sites[SITE_FRAME] && start_supervisor() < 0) {
+        LOG(FATAL, "failed to start the supervisor");
+        exit(EXIT_FAILURE);
+    }
+
+    // genuine w after each check of the save period
+    uint64_t period = 1ull << save;
+    size_t n_blocks = (size_t) (period >> check);
+    mpz_t* reference = malloc((n_blocks + 1) * sizeof(*reference));
+    if (reference == NULL) {
+        LOG(FATAL, "could not allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    session->t = period;
+    double start = real_clock();
+    for (size_t k = 0; k <= n_blocks; k += 1) {
+        mpz_init_set(reference[k], session->w);
+        session_work(session, 1ull << check);
+    }
+    double squaring_rate = (double) period / (real_clock() - start);
+    double check_seconds = check_cost(session);
+    harness.period = period;
+    harness.squaring_rate = squaring_rate;
+
+    gmp_printf("modulus: %zu bits, control prime: %Zd\n",
+               mpz_sizeinbase(session->n, 2), session->c);
+    printf("check every 2^%lu squarings, save every 2^%lu, %s faults, "
+           "%.0f squarings/s\n", check, save, word ? "word" : "bit",
+           squaring_rate);
+
+    struct report reports[N_SITES];
+    memset(reports, 0, sizeof(reports));
+    for (size_t s = 0; s < N_SITES; s += 1) {
+        for (uint64_t k = 0; sites[s] && k < n_trials; k += 1) {
+            if (s == SITE_FRAME) {
+                inject_frame(reference[n_blocks], word, &seed, &reports[s]);
+            } else {
+                inject_compute(session, reference, (unsigned) check,
+                               (enum site) s, word, &seed, &reports[s]);
+            }
+        }
+    }
+
+    // online: caught by work or by the supervisor; per fault detected
+    printf("%-8s %7s %7s %7s %8s %7s %7s %9s %11s %11s %10s\n", "site",
+           "faults", "work", "superv", "validate", "masked", "missed",
+           "online", "latency", "lost", "recovery");
+    for (size_t s = 0; s < N_SITES; s += 1) {
+        const struct report* report = &reports[s];
+        if (!sites[s]) {
+            continue;
+        }
+        uint64_t online = report->by_work + report->by_supervisor;
+        uint64_t harmful = report->n_faults - report->masked;
+        double latency =
+            online ? (double) report->latency / (double) online : 0;
+        double lost = online ? (double) report->lost / (double) online : 0;
+        // detection, then computing again what was lost
+        double recovery = (latency + lost) / squaring_rate;
+        printf("%-8s %7" PRIu64 " %7" PRIu64 " %7" PRIu64 " %8" PRIu64
+               " %7" PRIu64 " %7" PRIu64 " %8.2f%% %11.0f %11.0f %9.3fs\n",
+               site_names[s], report->n_faults, report->by_work,
+               report->by_supervisor, report->by_validate, report->masked,
+               report->missed,
+               harmful ? 100. * (double) online / (double) harmful : 100.,
+               latency, lost, recovery);
+    }
+
+    // offline: validate starts on each save, while work goes on
+    printf("%-8s %8s %11s %11s %10s\n", "validate", "caught", "latency",
+           "lost", "recovery");
+    for (size_t s = 0; s < N_SITES; s += 1) {
+        const struct report* report = &reports[s];
+        if (!sites[s]) {
+            continue;
+        }
+        double caught = (double) report->by_validate;
+        double latency = caught > 0 ? report->validate_latency / caught : 0;
+        double lost = caught > 0 ? report->validate_lost / caught : 0;
+        printf("%-8s %8" PRIu64 " %11.0f %11.0f %9.3fs\n", site_names[s],
+               report->by_validate, latency, lost,
+               (latency + lost) / squaring_rate);
+    }
+
+    // trade-off between the cost of checks and the work lost to faults
+    double check_overhead =
+        check_seconds * squaring_rate / (double) (1ull << check);
+    printf("overhead: %.4f%% for checks", 100 * check_overhead);
+    if (sites[SITE_W]) {
+        // seconds lost per fault in w, wherever it is detected
+        const struct report* report = &reports[SITE_W];
+        double w_recovery = report->n_faults == 0 ? 0 :
+            ((double) (report->latency + report->lost) +
+             report->validate_latency + report->validate_lost) /
+            squaring_rate / (double) report->n_faults;
+        printf(", %.4f%% for %g faults/hour in w", 100 * rate * w_recovery /
+               3600, rate);
+    }
+    printf("\n");
+
+    for (size_t k = 0; k <= n_blocks; k += 1) {
+        mpz_clear(reference[k]);
+    }
+    free(reference);
+    session_delete(session);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,312 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "multi.h" // source header
+
+// C90
+#include <stdlib.h>
+#include <string.h>
+
+// AVX-512 IFMA kernel, used when the CPU supports it
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(MULTI_NO_SIMD)
+#define MULTI_SIMD
+#include <immintrin.h>
+#endif
+
+__extension__ typedef unsigned __int128 u128;
+
+static void* alloc_limbs(size_t count) {
+    /* Zeroed limbs, aligned for SIMD loads */
+    void* ret;
+    if (posix_memalign(&ret, 64, count * sizeof(uint64_t)) != 0) {
+        return NULL;
+    }
+    memset(ret, 0, count * sizeof(uint64_t));
+    return ret;
+}
+
+extern int multi_simd(void) {
+    /* Whether multi_new() packs MULTI_MAX_LANES lanes in SIMD registers */
+#ifdef MULTI_SIMD
+    return __builtin_cpu_supports("avx512ifma");
+#else
+    return 0;
+#endif
+}
+
+extern struct multi* multi_new(const mpz_t modulus, size_t n_lanes) {
+    /* Lanes start at 0; modulus must be odd */
+    if (n_lanes == 0 || n_lanes > MULTI_MAX_LANES || mpz_even_p(modulus)) {
+        return NULL;
+    }
+    struct multi* multi = malloc(sizeof(*multi));
+    if (multi == NULL) {
+        return NULL;
+    }
+
+    // SIMD squares all MULTI_MAX_LANES lanes whether they are used or not;
+    // with fewer lanes, interleaving is faster
+    int simd = n_lanes == MULTI_MAX_LANES && multi_simd();
+    multi->kernel = simd ? "montgomery-ifma" : "montgomery-interleaved";
+    multi->n_lanes = n_lanes;
+    multi->stride = simd ? MULTI_MAX_LANES : n_lanes;
+    multi->limb_bits = simd ? 52 : 64;
+
+    // values lower than 2*modulus stay so through squarings if 4*modulus < R
+    size_t bits = mpz_sizeinbase(modulus, 2) + 2;
+    multi->n_limbs = (bits + multi->limb_bits - 1) / multi->limb_bits;
+    size_t n = multi->n_limbs;
+    size_t stride = multi->stride;
+    multi->modulus = alloc_limbs(simd ? n * stride : n);
+    multi->x = alloc_limbs(n * stride);
+    multi->scratch = alloc_limbs((2 * n + 1) * stride);
+    if (multi->modulus == NULL || multi->x == NULL || multi->scratch == NULL) {
+        free(multi->scratch);
+        free(multi->x);
+        free(multi->modulus);
+        free(multi);
+        return NULL;
+    }
+    size_t nails = 64 - multi->limb_bits;
+    mpz_export(multi->modulus, NULL, -1, sizeof(uint64_t), 0, nails, modulus);
+    if (simd) {
+        for (size_t j = n; j-- > 0;) {
+            for (size_t l = 0; l < stride; l += 1) {
+                multi->modulus[j * stride + l] = multi->modulus[j];
+            }
+        }
+    }
+
+    // Newton's iteration doubles the number of correct low bits each time
+    uint64_t m0 = multi->modulus[0];
+    uint64_t inverse = m0;  // correct modulo 2^3 for odd m0
+    for (int k = 0; k < 5; k += 1) {
+        inverse *= 2 - m0 * inverse;
+    }
+    multi->inverse = -inverse;
+    if (multi->limb_bits < 64) {
+        multi->inverse &= (1ull << multi->limb_bits) - 1;
+    }
+
+    mpz_init_set(multi->mpz_modulus, modulus);
+    mpz_init_set_ui(multi->r_inverse, 1);
+    mpz_mul_2exp(multi->r_inverse, multi->r_inverse, multi->limb_bits * n);
+    mpz_invert(multi->r_inverse, multi->r_inverse, modulus);
+    return multi;
+}
+
+extern void multi_delete(struct multi* multi) {
+    mpz_clear(multi->r_inverse);
+    mpz_clear(multi->mpz_modulus);
+    free(multi->scratch);
+    free(multi->x);
+    free(multi->modulus);
+    free(multi);
+}
+
+extern void multi_set(struct multi* multi, size_t lane, const mpz_t w) {
+    /* Load w in a lane, converting it to Montgomery form (w * R) */
+    size_t n = multi->n_limbs;
+    mpz_t tmp;
+    mpz_init(tmp);
+    mpz_mul_2exp(tmp, w, multi->limb_bits * n);
+    mpz_mod(tmp, tmp, multi->mpz_modulus);
+
+    uint64_t* limbs = multi->scratch;  // free between squarings
+    memset(limbs, 0, n * sizeof(*limbs));
+    mpz_export(limbs, NULL, -1, sizeof(*limbs), 0, 64 - multi->limb_bits,
+               tmp);
+    for (size_t j = 0; j < n; j += 1) {
+        multi->x[j * multi->stride + lane] = limbs[j];
+    }
+    mpz_clear(tmp);
+}
+
+extern void multi_get(const struct multi* multi, size_t lane, mpz_t w) {
+    /* Read the value of a lane in normal form */
+    size_t n = multi->n_limbs;
+    uint64_t* limbs = multi->scratch;
+    for (size_t j = 0; j < n; j += 1) {
+        limbs[j] = multi->x[j * multi->stride + lane];
+    }
+    mpz_import(w, n, -1, sizeof(*limbs), 0, 64 - multi->limb_bits, limbs);
+    mpz_mul(w, w, multi->r_inverse);
+    mpz_mod(w, w, multi->mpz_modulus);
+}
+
+static inline __attribute__((always_inline))
+void square(struct multi* multi, const size_t L) {
+    /* x = x^2 / R mod modulus in every lane
+     *
+     * Product scanning: column k of x^2 + q*modulus is accumulated in
+     * registers, and the low limb of q is chosen so that column k < n
+     * vanishes (Montgomery reduction). The loops over the lanes are
+     * independent multiply-add chains, which the compiler unrolls since L is
+     * a constant. */
+    const size_t n = multi->n_limbs;
+    const uint64_t* m = multi->modulus;
+    const uint64_t* x = multi->x;
+    uint64_t* q = multi->scratch;  // q[j * L + l]
+    uint64_t* result = multi->scratch + n * L;
+
+    // accumulator of a column, as acc + 2^128 * acc_high
+    u128 acc[MULTI_MAX_LANES];
+    uint64_t acc_high[MULTI_MAX_LANES];
+    for (size_t l = 0; l < L; l += 1) {
+        acc[l] = 0;
+        acc_high[l] = 0;
+    }
+
+    for (size_t k = 0; k < 2 * n - 1; k += 1) {
+        size_t first = k < n ? 0 : k - n + 1;
+        size_t last = k < n ? k : n - 1;
+
+        // x_i x_j with i < j, i + j = k, counted twice
+        u128 cross[MULTI_MAX_LANES];
+        uint64_t cross_high[MULTI_MAX_LANES];
+        for (size_t l = 0; l < L; l += 1) {
+            cross[l] = 0;
+            cross_high[l] = 0;
+        }
+        for (size_t i = first; 2 * i < k; i += 1) {
+            for (size_t l = 0; l < L; l += 1) {
+                u128 p = (u128) x[i*L+l] * x[(k-i)*L+l];
+                cross[l] += p;
+                cross_high[l] += cross[l] < p;
+            }
+        }
+        for (size_t l = 0; l < L; l += 1) {
+            u128 doubled = cross[l] << 1;
+            uint64_t doubled_high = cross_high[l] << 1 |
+                (uint64_t) (cross[l] >> 127);
+            acc[l] += doubled;
+            acc_high[l] += doubled_high + (acc[l] < doubled);
+        }
+        if (k % 2 == 0) {
+            for (size_t l = 0; l < L; l += 1) {
+                u128 p = (u128) x[k/2*L+l] * x[k/2*L+l];
+                acc[l] += p;
+                acc_high[l] += acc[l] < p;
+            }
+        }
+
+        // q_j m_(k-j) for the q_j already known
+        size_t q_last = k < n ? k : last + 1;
+        for (size_t j = first; j < q_last; j += 1) {
+            for (size_t l = 0; l < L; l += 1) {
+                u128 p = (u128) q[j*L+l] * m[k-j];
+                acc[l] += p;
+                acc_high[l] += acc[l] < p;
+            }
+        }
+        if (k < n) {
+            // cancel the low limb of the column
+            for (size_t l = 0; l < L; l += 1) {
+                q[k*L+l] = (uint64_t) acc[l] * multi->inverse;
+                u128 p = (u128) q[k*L+l] * m[0];
+                acc[l] += p;
+                acc_high[l] += acc[l] < p;
+            }
+        } else {
+            for (size_t l = 0; l < L; l += 1) {
+                result[(k-n)*L+l] = (uint64_t) acc[l];
+            }
+        }
+
+        // next column
+        for (size_t l = 0; l < L; l += 1) {
+            acc[l] = acc[l] >> 64 | (u128) acc_high[l] << 64;
+            acc_high[l] = 0;
+        }
+    }
+
+    // the result is lower than 2*modulus < R, so it fits in n limbs
+    for (size_t l = 0; l < L; l += 1) {
+        result[(n-1)*L+l] = (uint64_t) acc[l];
+    }
+    memcpy(multi->x, result, n * L * sizeof(*result));
+}
+
+#ifdef MULTI_SIMD
+__attribute__((target("avx512f,avx512ifma")))
+static void work_ifma(struct multi* multi, uint64_t amount) {
+    /* Same as square(), with the eight lanes in the 64-bit elements of a
+     * register
+     *
+     * Limbs hold 52 bits, so that the products split into 52-bit halves (the
+     * low half goes to column k, the high half to column k+1) that can be
+     * summed without carries; columns are normalized when they are complete. */
+    const size_t n = multi->n_limbs;
+    const __m512i mask = _mm512_set1_epi64((1ll << 52) - 1);
+    const __m512i inverse = _mm512_set1_epi64((long long) multi->inverse);
+    const __m512i* m = (const __m512i*) multi->modulus;
+    __m512i* x = (__m512i*) multi->x;
+    __m512i* q = (__m512i*) multi->scratch;
+    __m512i* result = q + n;
+
+    for (uint64_t step = 0; step < amount; step += 1) {
+        __m512i carry = _mm512_setzero_si512();
+        for (size_t k = 0; k < 2 * n; k += 1) {
+            // x_i x_j with i < j, for i + j = k (low) and i + j = k-1 (high)
+            __m512i cross = _mm512_setzero_si512();
+            for (size_t i = k < n ? 0 : k - n + 1; 2 * i < k; i += 1) {
+                cross = _mm512_madd52lo_epu64(cross, x[i], x[k-i]);
+            }
+            for (size_t i = k < n + 1 ? 0 : k - n; 2 * i + 1 < k; i += 1) {
+                cross = _mm512_madd52hi_epu64(cross, x[i], x[k-1-i]);
+            }
+            __m512i acc = _mm512_add_epi64(carry, _mm512_slli_epi64(cross, 1));
+            if (k % 2 == 0) {
+                acc = _mm512_madd52lo_epu64(acc, x[k/2], x[k/2]);
+            } else {
+                acc = _mm512_madd52hi_epu64(acc, x[k/2], x[k/2]);
+            }
+
+            // q_j m_(k-j) (low) and q_j m_(k-1-j) (high)
+            size_t q_last = k < n ? k : n;
+            for (size_t j = k < n ? 0 : k - n + 1; j < q_last; j += 1) {
+                acc = _mm512_madd52lo_epu64(acc, q[j], m[k-j]);
+            }
+            for (size_t j = k < n + 1 ? 0 : k - n; j < q_last; j += 1) {
+                acc = _mm512_madd52hi_epu64(acc, q[j], m[k-1-j]);
+            }
+            if (k < n) {
+                // cancel the low limb of the column
+                q[k] = _mm512_madd52lo_epu64(_mm512_setzero_si512(), acc,
+                                             inverse);
+                acc = _mm512_madd52lo_epu64(acc, q[k], m[0]);
+            } else {
+                result[k-n] = _mm512_and_si512(acc, mask);
+            }
+            carry = _mm512_srli_epi64(acc, 52);
+        }
+        memcpy(x, result, n * sizeof(*x));
+    }
+}
+#endif
+
+static inline __attribute__((always_inline))
+void work(struct multi* multi, uint64_t amount, const size_t L) {
+    for (uint64_t k = 0; k < amount; k += 1) {
+        square(multi, L);
+    }
+}
+
+extern void multi_work(struct multi* multi, uint64_t amount) {
+    /* Square every lane amount times */
+#ifdef MULTI_SIMD
+    if (multi->limb_bits == 52) {
+        work_ifma(multi, amount);
+        return;
+    }
+#endif
+    switch (multi->n_lanes) {
+    case 1: work(multi, amount, 1); break;
+    case 2: work(multi, amount, 2); break;
+    case 3: work(multi, amount, 3); break;
+    case 4: work(multi, amount, 4); break;
+    case 5: work(multi, amount, 5); break;
+    case 6: work(multi, amount, 6); break;
+    case 7: work(multi, amount, 7); break;
+    case 8: work(multi, amount, 8); break;
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef MULTI_H
+#define MULTI_H
+
+// external libraries
+#include <gmp.h>
+
+// C99
+#include <stdint.h>
+
+// C90
+#include <stddef.h>
+
+#define MULTI_MAX_LANES 8
+
+/* Independent repeated-squaring chains advanced in lock-step
+ *
+ * One chain of squarings is bound by the latency of each multiplication,
+ * which leaves most of the core idle. With several chains (lanes) sharing a
+ * modulus, the limb operations of the lanes are interleaved so that the
+ * multiplications of one lane fill the gaps left by the others. When the CPU
+ * supports AVX-512 IFMA and all MULTI_MAX_LANES lanes are requested, the
+ * lanes are packed into SIMD registers instead, with 52-bit limbs.
+ *
+ * Values are kept in Montgomery form, in [0, 2*modulus), with the limbs of all
+ * lanes interleaved: limb j of lane l is at x[j * stride + l]. */
+struct multi {
+    const char* kernel;  // name of the implementation in use
+    size_t n_lanes;
+    size_t stride;  // n_lanes, or MULTI_MAX_LANES with SIMD
+    unsigned limb_bits;  // 64, or 52 with SIMD
+    size_t n_limbs;
+    uint64_t* modulus;  // with SIMD, each limb is repeated in every lane
+    uint64_t inverse;  // -modulus^-1 mod 2^limb_bits
+    uint64_t* x;
+    uint64_t* scratch;
+    mpz_t mpz_modulus;
+    mpz_t r_inverse;  // 2^(-limb_bits * n_limbs) mod modulus
+};
+
+extern int multi_simd(void);
+extern struct multi* multi_new(const mpz_t modulus, size_t n_lanes);
+extern void multi_delete(struct multi* multi);
+
+extern void multi_set(struct multi* multi, size_t lane, const mpz_t w);
+extern void multi_get(const struct multi* multi, size_t lane, mpz_t w);
+extern void multi_work(struct multi* multi, uint64_t amount);
+
+#endif
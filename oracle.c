@@ -0,0 +1,241 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "oracle.h" // source header
+
+// local includes
+#include "util.h"
+
+// external libraries
+#include <sqlite3.h>
+
+// C99
+#include <inttypes.h>
+
+// C90
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern struct oracle* oracle_new(void) {
+    struct oracle* oracle = malloc(sizeof(*oracle));
+    if (oracle == NULL) {
+        return NULL;
+    }
+    oracle->prime_bits = 0;
+    oracle->t = 0;
+    mpz_init(oracle->p);
+    mpz_init(oracle->q);
+    mpz_init_set_str(oracle->c, "2446683847", 10);  // same as session_new()
+    mpz_init(oracle->n);
+    mpz_init(oracle->z);
+    mpz_init(oracle->n_times_c);
+    mpz_init(oracle->phi);
+    return oracle;
+}
+
+extern void oracle_delete(struct oracle* oracle) {
+    mpz_clear(oracle->phi);
+    mpz_clear(oracle->n_times_c);
+    mpz_clear(oracle->z);
+    mpz_clear(oracle->n);
+    mpz_clear(oracle->c);
+    mpz_clear(oracle->q);
+    mpz_clear(oracle->p);
+    free(oracle);
+}
+
+extern void oracle_next_prime(mpz_t p, const mpz_t start) {
+    /* getNextPrime() of the Java generator: first odd probable prime from
+     * start; unlike mpz_nextprime(), start itself is a candidate */
+    mpz_set(p, start);
+    if (mpz_even_p(p)) {
+        mpz_add_ui(p, p, 1);
+    }
+    while (!mpz_probab_prime_p(p, 40)) {
+        mpz_add_ui(p, p, 2);
+    }
+}
+
+static void update(struct oracle* oracle) {
+    /* Derive n, n*c and phi(n*c) from p, q and c */
+    mpz_mul(oracle->n, oracle->p, oracle->q);
+    mpz_mul(oracle->n_times_c, oracle->n, oracle->c);
+
+    mpz_t tmp;
+    mpz_init(tmp);
+    mpz_sub_ui(oracle->phi, oracle->p, 1);
+    mpz_sub_ui(tmp, oracle->q, 1);
+    mpz_mul(oracle->phi, oracle->phi, tmp);
+    mpz_sub_ui(tmp, oracle->c, 1);
+    mpz_mul(oracle->phi, oracle->phi, tmp);
+    mpz_clear(tmp);
+}
+
+extern void oracle_set_factors(struct oracle* oracle, const mpz_t p,
+                               const mpz_t q) {
+    /* Use a known factorization, as recovered by solve */
+    mpz_set(oracle->p, p);
+    mpz_set(oracle->q, q);
+    update(oracle);
+}
+
+// the secret, as in the Java generator
+#define SECRET_FORMAT "%s (seed value b for p = %s)"
+
+// bits by which n may fall short of 2*prime_bits in oracle_min_prime_bits();
+// p and q are below 2^(prime_bits - k) with probability 2^-k each
+#define SECRET_MARGIN 32
+
+extern unsigned oracle_min_prime_bits(const char* message,
+                                      unsigned seed_bits) {
+    /* Smallest prime_bits for which oracle_generate() fits the secret below
+     * n, for seeds of up to seed_bits bits */
+    mpz_t seed;
+    mpz_init(seed);
+    mpz_setbit(seed, seed_bits);
+    size_t length = strlen(SECRET_FORMAT) - 4 + strlen(message) +
+                    mpz_sizeinbase(seed, 10);
+    mpz_clear(seed);
+    return (unsigned) ((8 * length + SECRET_MARGIN + 1) / 2);
+}
+
+extern int oracle_generate(struct oracle* oracle, unsigned prime_bits,
+                           const mpz_t p_seed, const mpz_t q_seed,
+                           uint64_t t, const char* message) {
+    /* Create a puzzle as in CreatePuzzle() of the Java generator
+     *
+     * p is the first prime after 5^p_seed mod 2^prime_bits, and likewise for
+     * q; the secret is message followed by the seed for p, so that solving the
+     * puzzle gives the factorization of n. */
+    oracle->prime_bits = prime_bits;
+    oracle->t = t;
+
+    mpz_t two_power, start;
+    mpz_init(two_power);
+    mpz_init(start);
+    mpz_setbit(two_power, prime_bits);
+    mpz_set_ui(start, 5);  // 5 has maximal order modulo 2^k
+    mpz_powm(start, start, p_seed, two_power);
+    oracle_next_prime(oracle->p, start);
+    mpz_set_ui(start, 5);
+    mpz_powm(start, start, q_seed, two_power);
+    oracle_next_prime(oracle->q, start);
+    mpz_clear(start);
+    mpz_clear(two_power);
+
+    if (mpz_cmp(oracle->p, oracle->q) == 0 ||
+            mpz_cmp(oracle->p, oracle->c) == 0 ||
+            mpz_cmp(oracle->q, oracle->c) == 0) {
+        LOG(WARN, "p, q and c must be distinct primes");
+        return -1;
+    }
+    update(oracle);
+
+    // base-256 interpretation of the secret string
+    char* str_seed = mpz_get_str(NULL, 10, p_seed);
+    char* secret;
+    int ret = asprintf(&secret, SECRET_FORMAT, message, str_seed);
+    free(str_seed);
+    if (ret < 0) {
+        LOG(WARN, "failed to prepare secret");
+        return -1;
+    }
+    mpz_import(oracle->z, strlen(secret), 1, 1, 0, 0, secret);
+    free(secret);
+    if (mpz_cmp(oracle->z, oracle->n) >= 0) {
+        LOG(WARN, "secret too large for %u-bit primes", prime_bits);
+        return -1;
+    }
+
+    mpz_t w;
+    mpz_init(w);
+    oracle_w(oracle, t, w);
+    mpz_mod(w, w, oracle->n);
+    mpz_xor(oracle->z, oracle->z, w);
+    mpz_clear(w);
+    return 0;
+}
+
+extern void oracle_w(const struct oracle* oracle, uint64_t i, mpz_t w) {
+    /* w = 2^(2^i) mod n*c, as computed by session_work() from i = 0
+     *
+     * 2 is invertible modulo n*c, so its exponent can be reduced modulo
+     * phi(n*c) (Euler's theorem). */
+    mpz_t e;
+    mpz_init_set_ui(e, 2);
+    mpz_t exponent;
+    mpz_init(exponent);
+    mpz_import(exponent, 1, -1, sizeof(i), 0, 0, &i);
+    mpz_powm(e, e, exponent, oracle->phi);  // 2^i mod phi(n*c)
+    mpz_set_ui(w, 2);
+    mpz_powm(w, w, e, oracle->n_times_c);
+    mpz_clear(exponent);
+    mpz_clear(e);
+}
+
+extern int oracle_load(struct oracle* oracle, struct store* store) {
+    /* Read the test puzzle held by a database
+     *
+     * returns 1 if the database holds a test puzzle
+     * returns 0 if it is for LCS35 itself
+     * returns -1 if an error was encountered */
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(store->db,
+            "SELECT c, t, z, p, q, prime_bits FROM parameter LIMIT 1", -1,
+            &stmt, NULL) != SQLITE_OK) {
+        LOG(WARN, "sqlite3_prepare_v2: %s", sqlite3_errmsg(store->db));
+        return -1;
+    }
+    int ret = 0;
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        ret = 1;
+        mpz_t* values[] = {&oracle->c, NULL, &oracle->z, &oracle->p,
+                           &oracle->q};
+        for (int k = 0; k < 5; k += 1) {
+            const char* str = (const char*) sqlite3_column_text(stmt, k);
+            if (values[k] != NULL &&
+                    (str == NULL || mpz_set_str(*values[k], str, 10) < 0)) {
+                LOG(WARN, "invalid puzzle parameters");
+                ret = -1;
+            }
+        }
+        oracle->t = (uint64_t) sqlite3_column_int64(stmt, 1);
+        oracle->prime_bits = (unsigned) sqlite3_column_int(stmt, 5);
+        update(oracle);
+    } else if (rc != SQLITE_DONE) {
+        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    }
+    sqlite3_finalize(stmt);
+    return ret;
+}
+
+extern int oracle_save(const struct oracle* oracle, struct store* store) {
+    /* Record the puzzle in a database, so that work and validate use it */
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(store->db,
+            "INSERT INTO parameter (n, c, t, z, p, q, prime_bits) "
+            "VALUES (?, ?, ?, ?, ?, ?, ?)", -1, &stmt, NULL) != SQLITE_OK) {
+        LOG(WARN, "sqlite3_prepare_v2: %s", sqlite3_errmsg(store->db));
+        return -1;
+    }
+    const mpz_t* values[] = {&oracle->n, &oracle->c, NULL, &oracle->z,
+                             &oracle->p, &oracle->q};
+    for (int k = 0; k < 6; k += 1) {
+        if (values[k] != NULL) {
+            sqlite3_bind_text(stmt, k + 1, mpz_get_str(NULL, 10, *values[k]),
+                              -1, free);
+        }
+    }
+    sqlite3_bind_int64(stmt, 3, (sqlite_int64) oracle->t);
+    sqlite3_bind_int(stmt, 7, (int) oracle->prime_bits);
+
+    int ret = 0;
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    }
+    sqlite3_finalize(stmt);
+    return ret;
+}
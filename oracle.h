@@ -0,0 +1,49 @@
+#ifndef ORACLE_H
+#define ORACLE_H
+
+// local includes
+#include "store.h"
+
+// external libraries
+#include <gmp.h>
+
+// C99
+#include <stdint.h>
+
+// recorded for the values of w given by oracle_w(), which go through phi
+#define ORACLE_KERNEL "factorization"
+
+/* Test puzzle whose factorization is known
+ *
+ * Generated the same way as LCS35 (see lcs35-puzzle-description.txt), but of
+ * any size. Knowing phi(n*c) gives w = 2^(2^i) mod n*c for any i with a
+ * couple of modular exponentiations, instead of i squarings. */
+struct oracle {
+    unsigned prime_bits;  // size of p and q
+    uint64_t t;  // target exponent
+    mpz_t p;
+    mpz_t q;
+    mpz_t c;  // control prime, as in struct session
+    mpz_t n;  // p*q
+    mpz_t z;  // secret message xor w mod n
+    mpz_t n_times_c;
+    mpz_t phi;  // Euler's totient of n*c
+};
+
+extern struct oracle* oracle_new(void);
+extern void oracle_delete(struct oracle* oracle);
+
+extern void oracle_next_prime(mpz_t p, const mpz_t start);
+extern unsigned oracle_min_prime_bits(const char* message,
+                                      unsigned seed_bits);
+extern void oracle_set_factors(struct oracle* oracle, const mpz_t p,
+                               const mpz_t q);
+extern int oracle_generate(struct oracle* oracle, unsigned prime_bits,
+                           const mpz_t p_seed, const mpz_t q_seed,
+                           uint64_t t, const char* message);
+extern void oracle_w(const struct oracle* oracle, uint64_t i, mpz_t w);
+
+extern int oracle_load(struct oracle* oracle, struct store* store);
+extern int oracle_save(const struct oracle* oracle, struct store* store);
+
+#endif
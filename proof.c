@@ -0,0 +1,395 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "proof.h" // source header
+
+// local includes
+#include "bundle.h"
+#include "sha256.h"
+#include "util.h"
+
+// C90
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void put_u32(unsigned char* p, uint32_t v) {
+    for (int k = 0; k < 4; k += 1) {
+        p[k] = (unsigned char) (v >> (8 * k));
+    }
+}
+
+static void put_u64(unsigned char* p, uint64_t v) {
+    for (int k = 0; k < 8; k += 1) {
+        p[k] = (unsigned char) (v >> (8 * k));
+    }
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    uint32_t v = 0;
+    for (int k = 3; k >= 0; k -= 1) {
+        v = (v << 8) | p[k];
+    }
+    return v;
+}
+
+static uint64_t get_u64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int k = 7; k >= 0; k -= 1) {
+        v = (v << 8) | p[k];
+    }
+    return v;
+}
+
+static size_t element_size(const mpz_t n) {
+    return (mpz_sizeinbase(n, 2) + 7) / 8;
+}
+
+static void encode(unsigned char* p, size_t size, const mpz_t x) {
+    /* Little-endian bytes of x, padded to size (x must fit) */
+    size_t count;
+    memset(p, 0, size);
+    mpz_export(p, &count, -1, 1, 0, 0, x);
+}
+
+static unsigned floor_log2(uint64_t t) {
+    /* floor(log2(t)), 0 if t is 0 */
+    unsigned log2 = 0;
+    while (t >> log2 > 1) {
+        log2 += 1;
+    }
+    return log2;
+}
+
+extern struct proof* proof_new(const mpz_t n, uint64_t t) {
+    /* Empty proof for t, with an end per bit of t and a midpoint per round */
+    struct proof* proof = calloc(1, sizeof(*proof));
+    if (proof == NULL) {
+        return NULL;
+    }
+    proof->t = t;
+    mpz_init_set(proof->n, n);
+    for (unsigned b = 0; b < 64; b += 1) {
+        proof->n_segments += (t >> b) & 1;
+    }
+    proof->n_rounds = floor_log2(t);
+    // one more element each, so that they are never empty
+    proof->ends = malloc((proof->n_segments + 1) * sizeof(*proof->ends));
+    proof->mu = malloc((proof->n_rounds + 1) * sizeof(*proof->mu));
+    if (proof->ends == NULL || proof->mu == NULL) {
+        free(proof->ends);
+        free(proof->mu);
+        mpz_clear(proof->n);
+        free(proof);
+        return NULL;
+    }
+    for (size_t k = 0; k < proof->n_segments; k += 1) {
+        mpz_init(proof->ends[k]);
+    }
+    for (unsigned j = 0; j < proof->n_rounds; j += 1) {
+        mpz_init(proof->mu[j]);
+    }
+    return proof;
+}
+
+extern void proof_delete(struct proof* proof) {
+    for (unsigned j = 0; j < proof->n_rounds; j += 1) {
+        mpz_clear(proof->mu[j]);
+    }
+    for (size_t k = 0; k < proof->n_segments; k += 1) {
+        mpz_clear(proof->ends[k]);
+    }
+    free(proof->mu);
+    free(proof->ends);
+    mpz_clear(proof->n);
+    free(proof);
+}
+
+static int write_element(FILE* f, unsigned char* buffer, size_t size,
+                         const mpz_t x, uint32_t* crc) {
+    encode(buffer, size, x);
+    *crc = crc32(*crc, buffer, size);
+    return fwrite(buffer, 1, size, f) == size ? 0 : -1;
+}
+
+extern int proof_write(const struct proof* proof, const char* filename) {
+    /* Write the proof in the format described in proof.h */
+    FILE* f = fopen(filename, "wb");
+    if (f == NULL) {
+        LOG(WARN, "failed to open %s (%s)", filename, strerror(errno));
+        return -1;
+    }
+    size_t size = element_size(proof->n);
+    unsigned char* buffer = malloc(size);
+    if (buffer == NULL) {
+        fclose(f);
+        return -1;
+    }
+
+    unsigned char header[PROOF_HEADER_SIZE];
+    memcpy(header, PROOF_MAGIC, 8);
+    put_u32(header + 8, PROOF_VERSION);
+    put_u32(header + 12, (uint32_t) size);
+    put_u64(header + 16, proof->t);
+    uint32_t crc = crc32(0, header, sizeof(header));
+    int ret = fwrite(header, 1, sizeof(header), f) == sizeof(header) ? 0 : -1;
+    if (ret == 0) {
+        ret = write_element(f, buffer, size, proof->n, &crc);
+    }
+    for (size_t k = 0; ret == 0 && k < proof->n_segments; k += 1) {
+        ret = write_element(f, buffer, size, proof->ends[k], &crc);
+    }
+    for (unsigned j = 0; ret == 0 && j < proof->n_rounds; j += 1) {
+        ret = write_element(f, buffer, size, proof->mu[j], &crc);
+    }
+    unsigned char trailer[4];
+    put_u32(trailer, crc);
+    if (ret == 0 &&
+            fwrite(trailer, 1, sizeof(trailer), f) != sizeof(trailer)) {
+        ret = -1;
+    }
+    free(buffer);
+    if (fclose(f) != 0) {
+        ret = -1;
+    }
+    if (ret < 0) {
+        LOG(WARN, "failed to write %s", filename);
+    }
+    return ret;
+}
+
+static unsigned char* read_file(const char* filename, size_t* size) {
+    /* Whole content of a file */
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) {
+        LOG(WARN, "failed to open %s (%s)", filename, strerror(errno));
+        return NULL;
+    }
+    size_t capacity = 1 << 16;
+    unsigned char* data = malloc(capacity);
+    *size = 0;
+    while (data != NULL) {
+        *size += fread(data + *size, 1, capacity - *size, f);
+        if (*size < capacity) {
+            break;
+        }
+        capacity *= 2;
+        unsigned char* bigger = realloc(data, capacity);
+        if (bigger == NULL) {
+            free(data);
+        }
+        data = bigger;
+    }
+    if (data != NULL && ferror(f)) {
+        LOG(WARN, "failed to read %s", filename);
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+extern struct proof* proof_read(const char* filename) {
+    /* Load a proof written by proof_write(), checking its layout and CRC */
+    size_t file_size;
+    unsigned char* data = read_file(filename, &file_size);
+    if (data == NULL) {
+        return NULL;
+    }
+    if (file_size < PROOF_HEADER_SIZE + 4 ||
+            memcmp(data, PROOF_MAGIC, 8) != 0) {
+        LOG(WARN, "%s is not a proof", filename);
+        free(data);
+        return NULL;
+    }
+    if (get_u32(data + 8) != PROOF_VERSION) {
+        LOG(WARN, "unsupported proof version %u", get_u32(data + 8));
+        free(data);
+        return NULL;
+    }
+    size_t size = get_u32(data + 12);
+    uint64_t t = get_u64(data + 16);
+
+    // one element for n, then one per segment and one per midpoint
+    uint64_t n_elements = 1 + floor_log2(t);
+    for (unsigned b = 0; b < 64; b += 1) {
+        n_elements += (t >> b) & 1;
+    }
+    size_t body_size = file_size - PROOF_HEADER_SIZE - 4;
+    if (size == 0 || body_size / size != n_elements ||
+            body_size % size != 0) {
+        LOG(WARN, "%s is truncated or malformed", filename);
+        free(data);
+        return NULL;
+    }
+    if (crc32(0, data, file_size - 4) != get_u32(data + file_size - 4)) {
+        LOG(WARN, "%s is corrupted (CRC mismatch)", filename);
+        free(data);
+        return NULL;
+    }
+
+    const unsigned char* p = data + PROOF_HEADER_SIZE;
+    mpz_t n;
+    mpz_init(n);
+    mpz_import(n, size, -1, 1, 0, 0, p);
+    p += size;
+    struct proof* proof = proof_new(n, t);
+    mpz_clear(n);
+    if (proof == NULL) {
+        free(data);
+        return NULL;
+    }
+    for (size_t k = 0; k < proof->n_segments; k += 1) {
+        mpz_import(proof->ends[k], size, -1, 1, 0, 0, p);
+        p += size;
+    }
+    for (unsigned j = 0; j < proof->n_rounds; j += 1) {
+        mpz_import(proof->mu[j], size, -1, 1, 0, 0, p);
+        p += size;
+    }
+    free(data);
+    return proof;
+}
+
+static void hash_element(struct sha256* sha, unsigned char* buffer,
+                         size_t size, const mpz_t x) {
+    encode(buffer, size, x);
+    sha256_update(sha, buffer, size);
+}
+
+static void challenge(mpz_t r, const mpz_t n, mpz_srcptr* elements,
+                      size_t count, unsigned log2) {
+    /* r is twice the first PROOF_CHALLENGE_BITS bits of SHA-256 over n, the
+     * elements and log2; all elements must be lower than n */
+    size_t size = element_size(n);
+    unsigned char* buffer = malloc(size);
+    if (buffer == NULL) {
+        LOG(FATAL, "could not allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    struct sha256 sha;
+    sha256_init(&sha);
+    sha256_update(&sha, PROOF_MAGIC, 8);
+    hash_element(&sha, buffer, size, n);
+    for (size_t k = 0; k < count; k += 1) {
+        hash_element(&sha, buffer, size, elements[k]);
+    }
+    unsigned char bytes[4];
+    put_u32(bytes, log2);
+    sha256_update(&sha, bytes, sizeof(bytes));
+    free(buffer);
+
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    sha256_final(&sha, digest);
+    mpz_import(r, PROOF_CHALLENGE_BITS / 8, 1, 1, 0, 0, digest);
+    mpz_mul_2exp(r, r, 1);
+}
+
+extern void proof_challenge(mpz_t r, const mpz_t n, const mpz_t x,
+                            const mpz_t y, const mpz_t mu, unsigned log2) {
+    /* Fiat-Shamir challenge for halving the claim x^(2^(2^log2)) = y with
+     * the midpoint mu */
+    mpz_srcptr elements[] = {x, y, mu};
+    challenge(r, n, elements, 3, log2);
+}
+
+extern void proof_halve(mpz_t x, mpz_t y, const mpz_t mu, const mpz_t r,
+                        const mpz_t n) {
+    /* Replace the claim (x, y) by (x^r mu, mu^r y) */
+    mpz_powm(x, x, r, n);
+    mpz_mul(x, x, mu);
+    mpz_mod(x, x, n);
+    mpz_t tmp;
+    mpz_init(tmp);
+    mpz_powm(tmp, mu, r, n);
+    mpz_mul(y, y, tmp);
+    mpz_mod(y, y, n);
+    mpz_clear(tmp);
+}
+
+extern void proof_merge_challenge(mpz_t r, const mpz_t n, const mpz_t x,
+                                  const mpz_t y, const mpz_t x2,
+                                  const mpz_t y2, unsigned log2) {
+    /* Fiat-Shamir challenge for folding the claim x2^(2^(2^log2)) = y2 into
+     * x^(2^(2^log2)) = y; hashing one more element than proof_challenge()
+     * keeps both kinds of challenges apart */
+    mpz_srcptr elements[] = {x, y, x2, y2};
+    challenge(r, n, elements, 4, log2);
+}
+
+extern void proof_merge(mpz_t x, mpz_t y, const mpz_t x2, const mpz_t y2,
+                        const mpz_t r, const mpz_t n) {
+    /* Replace the claim (x, y) by (x x2^r, y y2^r) */
+    mpz_t tmp;
+    mpz_init(tmp);
+    mpz_powm(tmp, x2, r, n);
+    mpz_mul(x, x, tmp);
+    mpz_mod(x, x, n);
+    mpz_powm(tmp, y2, r, n);
+    mpz_mul(y, y, tmp);
+    mpz_mod(y, y, n);
+    mpz_clear(tmp);
+}
+
+static int is_unit(const mpz_t x, const mpz_t n) {
+    /* Whether 0 < x < n and x is invertible modulo n */
+    int ret;
+    mpz_t g;
+    mpz_init(g);
+    mpz_gcd(g, x, n);
+    ret = mpz_sgn(x) > 0 && mpz_cmp(x, n) < 0 && mpz_cmp_ui(g, 1) == 0;
+    mpz_clear(g);
+    return ret;
+}
+
+extern int proof_verify(const struct proof* proof, mpz_t w) {
+    /* Check the proof; on success, w is set to 2^(2^t) mod n
+     *
+     * returns 1 if the proof is valid
+     * returns 0 otherwise */
+    int valid = proof->t > 0 && mpz_cmp_ui(proof->n, 2) > 0 &&
+                mpz_odd_p(proof->n);
+    for (size_t k = 0; valid && k < proof->n_segments; k += 1) {
+        valid = is_unit(proof->ends[k], proof->n);
+    }
+    for (unsigned j = 0; valid && j < proof->n_rounds; j += 1) {
+        valid = is_unit(proof->mu[j], proof->n);
+    }
+    if (!valid) {
+        return 0;
+    }
+
+    // the claim starts as the longest segment, from w = 2
+    mpz_t x, y, r;
+    mpz_init_set_ui(x, 2);
+    mpz_init_set(y, proof->ends[0]);
+    mpz_init(r);
+    size_t k = 0;
+    for (unsigned b = proof->n_rounds; ; b -= 1) {
+        // fold in the next segment once the claim is as long
+        if (b < proof->n_rounds && ((proof->t >> b) & 1) != 0) {
+            k += 1;
+            proof_merge_challenge(r, proof->n, x, y, proof->ends[k-1],
+                                  proof->ends[k], b);
+            proof_merge(x, y, proof->ends[k-1], proof->ends[k], r, proof->n);
+        }
+        if (b == 0) {
+            break;
+        }
+        mpz_srcptr mu = proof->mu[proof->n_rounds - b];
+        proof_challenge(r, proof->n, x, y, mu, b);
+        proof_halve(x, y, mu, r, proof->n);
+    }
+
+    // a single squaring is left
+    mpz_mul(x, x, x);
+    mpz_mod(x, x, proof->n);
+    valid = mpz_cmp(x, y) == 0;
+    if (valid) {
+        mpz_set(w, proof->ends[proof->n_segments - 1]);
+    }
+    mpz_clear(r);
+    mpz_clear(y);
+    mpz_clear(x);
+    return valid;
+}
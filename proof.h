@@ -0,0 +1,70 @@
+#ifndef PROOF_H
+#define PROOF_H
+
+// external libraries
+#include <gmp.h>
+
+// C99
+#include <stdint.h>
+
+// C90
+#include <stddef.h>
+
+/* Proof that w = 2^(2^t) mod n, checked in O(log t) exponentiations
+ *
+ * The chain from i = 0 to t is cut by the binary decomposition of t into
+ * segments of 2^b squarings, longest first, so that each one starts at a
+ * multiple of its length. The claims of all segments are proven together
+ * with Pietrzak's recursive halving: given the midpoint mu =
+ * x^(2^(2^(b-1))) of the claim (x, y, b) and a challenge r derived from (n,
+ * x, y, mu, b), the claim becomes (x^r mu, mu^r y, b-1). Once it is as long
+ * as the next segment (x', y'), both are folded into (x x'^r, y y'^r, b)
+ * with another challenge, until y = x^2 is checked directly. The midpoints
+ * thus stay at multiples of the lengths, where the checkpoints are. r is
+ * even, so that a factor -1 (the only element of small order known without
+ * factoring n) slipped into some mu cannot turn a false claim into a true
+ * one.
+ *
+ * File format, all integers little-endian:
+ *
+ *   header     magic "LCS35PRF", version (u32), element size (u32), t (u64)
+ *   n          element size bytes
+ *   ends       for each bit b of t, from the highest: the value of w at the
+ *              end of the segment, element size bytes
+ *   midpoints  for each claim of 2^b squarings, from b = floor(log2(t))
+ *              down to 1, element size bytes
+ *   trailer    CRC-32 of all previous bytes (u32)
+ */
+#define PROOF_MAGIC "LCS35PRF"
+#define PROOF_VERSION 2
+#define PROOF_HEADER_SIZE 24
+// bits of the challenges, before doubling
+#define PROOF_CHALLENGE_BITS 128
+
+struct proof {
+    uint64_t t;
+    mpz_t n;
+    size_t n_segments;  // one per bit of t
+    mpz_t* ends;  // w at the end of each segment; the last one is the result
+    unsigned n_rounds;  // floor(log2(t)), 0 if t is 0
+    mpz_t* mu;  // midpoints of the claims of 2^n_rounds to 2 squarings
+};
+
+extern struct proof* proof_new(const mpz_t n, uint64_t t);
+extern void proof_delete(struct proof* proof);
+
+extern int proof_write(const struct proof* proof, const char* filename);
+extern struct proof* proof_read(const char* filename);
+
+extern void proof_challenge(mpz_t r, const mpz_t n, const mpz_t x,
+                            const mpz_t y, const mpz_t mu, unsigned log2);
+extern void proof_halve(mpz_t x, mpz_t y, const mpz_t mu, const mpz_t r,
+                        const mpz_t n);
+extern void proof_merge_challenge(mpz_t r, const mpz_t n, const mpz_t x,
+                                  const mpz_t y, const mpz_t x2,
+                                  const mpz_t y2, unsigned log2);
+extern void proof_merge(mpz_t x, mpz_t y, const mpz_t x2, const mpz_t y2,
+                        const mpz_t r, const mpz_t n);
+extern int proof_verify(const struct proof* proof, mpz_t w);
+
+#endif
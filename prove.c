@@ -0,0 +1,379 @@
+#define _POSIX_C_SOURCE 200809L
+
+// local includes
+#include "checkpoints.h"
+#include "proof.h"
+#include "time.h"
+#include "util.h"
+
+// C99
+#include <inttypes.h>
+
+// C90
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// midpoints are combined from at most 2^MAX_TERMS_LOG2 checkpoints
+#define MAX_TERMS_LOG2 16
+#define MAX_TERMS (1ull << MAX_TERMS_LOG2)
+
+struct prover {
+    struct checkpoints* checkpoints;
+    mpz_t n;
+    uint64_t squarings;  // done by the prover, beyond the checkpoints
+    uint64_t last_i;  // end of the last segment computed
+    mpz_t last_w;  // w at last_i
+    // the current claim starts at prod(w at starts[k] ^ coefficients[k])
+    uint64_t* starts;
+    mpz_t* coefficients;
+    size_t n_terms;
+    /* values kept while squaring past the last checkpoint, to be combined
+     * like checkpoints: saved[m] is w at saved_from_i + m 2^saved_log2, for
+     * first_saved <= m < n_saved */
+    mpz_t* saved;
+    uint64_t saved_from_i;
+    unsigned saved_log2;
+    size_t first_saved;
+    size_t n_saved;
+};
+
+static const struct checkpoint* find_checkpoint(
+        const struct checkpoints* checkpoints, uint64_t i) {
+    /* Last checkpoint at or before i, NULL if there is none */
+    size_t low = 0;
+    size_t high = checkpoints->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (checkpoints->items[mid].i <= i) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low == 0 ? NULL : &checkpoints->items[low - 1];
+}
+
+static void square(struct prover* prover, mpz_t x, uint64_t count) {
+    /* x = x^(2^count) mod n, as session_work() does, by blocks of 2**20 */
+    mpz_t e;
+    mpz_init(e);
+    while (count > 0) {
+        uint64_t amount = count < 1ull<<20 ? count : 1ull<<20;
+        mpz_set_ui(e, 0);
+        mpz_setbit(e, (unsigned long) amount);
+        mpz_powm(x, x, e, prover->n);
+        count -= amount;
+        prover->squarings += amount;
+    }
+    mpz_clear(e);
+}
+
+static mpz_srcptr point_at(const struct prover* prover, uint64_t i) {
+    /* w at i from a checkpoint or a saved value, NULL if there is none */
+    const struct checkpoint* checkpoint =
+        find_checkpoint(prover->checkpoints, i);
+    if (checkpoint != NULL && checkpoint->i == i) {
+        return checkpoint->w;
+    }
+    if (i < prover->saved_from_i) {
+        return NULL;
+    }
+    uint64_t offset = i - prover->saved_from_i;
+    size_t m = (size_t) (offset >> prover->saved_log2);
+    if ((offset & ((1ull << prover->saved_log2) - 1)) != 0 ||
+            m < prover->first_saved || m >= prover->n_saved) {
+        return NULL;
+    }
+    return prover->saved[m];
+}
+
+static void advance(struct prover* prover, mpz_t w, uint64_t i,
+                    uint64_t to_i) {
+    /* w = w at to_i, from w at i, keeping the values to save on the way */
+    while (i < to_i) {
+        uint64_t next_i = to_i;
+        size_t m = prover->n_saved;
+        if (i >= prover->saved_from_i) {
+            uint64_t offset = i - prover->saved_from_i;
+            m = (size_t) (offset >> prover->saved_log2) + 1;
+        }
+        if (m < prover->n_saved) {
+            uint64_t save_i = prover->saved_from_i +
+                              ((uint64_t) m << prover->saved_log2);
+            if (save_i < next_i) {
+                next_i = save_i;
+            }
+        }
+        square(prover, w, next_i - i);
+        i = next_i;
+        if (m < prover->n_saved && i < to_i) {
+            mpz_set(prover->saved[m], w);
+            if (m < prover->first_saved) {
+                prover->first_saved = m;
+            }
+        }
+    }
+}
+
+static void value_at(struct prover* prover, mpz_t w, uint64_t i) {
+    /* w at i, from the last checkpoint at or before i, or from the end of the
+     * last segment when it is closer; i must not be before the latter */
+    const struct checkpoint* checkpoint =
+        find_checkpoint(prover->checkpoints, i);
+    if (checkpoint == NULL || checkpoint->i <= prover->last_i) {
+        mpz_set(w, prover->last_w);
+        advance(prover, w, prover->last_i, i);
+    } else {
+        mpz_mod(w, checkpoint->w, prover->n);
+        advance(prover, w, checkpoint->i, i);
+    }
+}
+
+static void save_tail(struct prover* prover, uint64_t t) {
+    /* Keep up to MAX_TERMS values between the last checkpoint before t and
+     * t, on the finest grid that fits; the midpoints of the claims of 2^b
+     * squarings are odd multiples of 2^(b-1) */
+    const struct checkpoint* checkpoint =
+        find_checkpoint(prover->checkpoints, t);
+    uint64_t from_i = checkpoint == NULL ? 0 : checkpoint->i;
+    unsigned log2 = 0;
+    while ((t - (from_i >> log2 << log2)) >> log2 >= MAX_TERMS) {
+        log2 += 1;
+    }
+    prover->saved_from_i = from_i >> log2 << log2;
+    prover->saved_log2 = log2;
+    prover->n_saved = (size_t) ((t - prover->saved_from_i) >> log2) + 1;
+    prover->first_saved = prover->n_saved;
+}
+
+static int worth_combining(const struct prover* prover, unsigned log2,
+                           unsigned j) {
+    /* Whether the midpoint of round j, for a claim of 2^log2 squarings, is
+     * cheaper to combine from the terms of the claim than to compute from it
+     *
+     * The combination takes an exponentiation per term by numbers of about j
+     * challenges, while the direct computation takes half of the remaining
+     * squarings. */
+    uint64_t half = 1ull << (log2 - 1);
+    uint64_t n_terms = prover->n_terms;
+    return n_terms * (j * (PROOF_CHALLENGE_BITS + 1) + 1) < half;
+}
+
+static int can_combine(const struct prover* prover, unsigned log2,
+                       unsigned j) {
+    /* Whether the midpoint of round j is better combined from checkpoints or
+     * saved values than computed from the current claim */
+    if (!worth_combining(prover, log2, j)) {
+        return 0;
+    }
+    uint64_t half = 1ull << (log2 - 1);
+    for (size_t k = 0; k < prover->n_terms; k += 1) {
+        if (point_at(prover, prover->starts[k] + half) == NULL) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void combine(struct prover* prover, mpz_t mu, unsigned log2) {
+    /* mu = prod(w at the midpoints of the terms ^ coefficient)
+     *
+     * The claim is x^(2^half) = y with x the product of the values at the
+     * starts of the terms raised to the coefficients, so that mu is the same
+     * product one half further. */
+    uint64_t half = 1ull << (log2 - 1);
+    mpz_t term;
+    mpz_init(term);
+    mpz_set_ui(mu, 1);
+    for (size_t k = 0; k < prover->n_terms; k += 1) {
+        mpz_powm(term, point_at(prover, prover->starts[k] + half),
+                 prover->coefficients[k], prover->n);
+        mpz_mul(mu, mu, term);
+        mpz_mod(mu, mu, prover->n);
+    }
+    mpz_clear(term);
+}
+
+static void prove(struct prover* prover, struct proof* proof) {
+    /* Ends of the segments, then midpoints of all the rounds */
+    save_tail(prover, proof->t);
+    uint64_t i = 0;
+    size_t k = 0;
+    for (unsigned b = 64; b-- > 0;) {
+        if (((proof->t >> b) & 1) != 0) {
+            i += 1ull << b;
+            value_at(prover, proof->ends[k], i);
+            prover->last_i = i;
+            mpz_set(prover->last_w, proof->ends[k]);
+            k += 1;
+        }
+    }
+
+    // the claim starts as the longest segment, from w = 2 at i = 0
+    mpz_t x, y, r;
+    mpz_init_set_ui(x, 2);
+    mpz_init_set(y, proof->ends[0]);
+    mpz_init(r);
+    prover->starts[0] = 0;
+    mpz_set_ui(prover->coefficients[0], 1);
+    prover->n_terms = 1;
+    int combining = 1;
+    unsigned n_combined = 0;
+    uint64_t next_i = 1ull << proof->n_rounds;  // start of the next segment
+    k = 0;
+    for (unsigned b = proof->n_rounds; ; b -= 1) {
+        // folding (x', y') in adds a term at its start, with coefficient r
+        if (b < proof->n_rounds && ((proof->t >> b) & 1) != 0) {
+            k += 1;
+            proof_merge_challenge(r, prover->n, x, y, proof->ends[k-1],
+                                  proof->ends[k], b);
+            proof_merge(x, y, proof->ends[k-1], proof->ends[k], r,
+                        prover->n);
+            if (prover->n_terms < MAX_TERMS) {
+                prover->starts[prover->n_terms] = next_i;
+                mpz_set(prover->coefficients[prover->n_terms], r);
+                prover->n_terms += 1;
+            } else {
+                combining = 0;
+            }
+            next_i += 1ull << b;
+        }
+        if (b == 0) {
+            break;
+        }
+
+        unsigned j = proof->n_rounds - b;
+        combining = combining && can_combine(prover, b, j);
+        if (combining) {
+            combine(prover, proof->mu[j], b);
+            n_combined += 1;
+        } else {
+            // the remaining rounds cost about as much as this one
+            mpz_set(proof->mu[j], x);
+            square(prover, proof->mu[j], 1ull << (b - 1));
+        }
+        proof_challenge(r, prover->n, x, y, proof->mu[j], b);
+        proof_halve(x, y, proof->mu[j], r, prover->n);
+
+        // x^r mu: each term is raised to r, and continued by a term at its
+        // midpoint with its former coefficient
+        if (combining && 2 * prover->n_terms <= MAX_TERMS) {
+            size_t n_terms = prover->n_terms;
+            for (size_t m = 0; m < n_terms; m += 1) {
+                prover->starts[n_terms + m] =
+                    prover->starts[m] + (1ull << (b - 1));
+                mpz_set(prover->coefficients[n_terms + m],
+                        prover->coefficients[m]);
+                mpz_mul(prover->coefficients[m], prover->coefficients[m], r);
+            }
+            prover->n_terms = 2 * n_terms;
+        } else {
+            combining = 0;
+        }
+    }
+    printf("%u of %u midpoints combined\n", n_combined, proof->n_rounds);
+
+    mpz_clear(r);
+    mpz_clear(y);
+    mpz_clear(x);
+}
+
+extern int main(int argc, char** argv) {
+    // parse arguments
+    parse_debug_args(&argc, argv);
+    uint64_t t = 0;
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-t") == 0) {
+            t = strtoull(argv[arg+1], NULL, 0);
+        } else {
+            break;
+        }
+        arg += 2;
+    }
+    if (argc != arg + 2) {
+        LOG(FATAL, "usage: %s [-t i] savefile.db|checkpoints.bundle "
+            "proof.bin", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    const char* filename = argv[arg];
+    const char* proof_filename = argv[arg+1];
+
+    struct prover prover;
+    prover.checkpoints = checkpoints_load(filename);
+    if (prover.checkpoints == NULL) {
+        LOG(FATAL, "failed to load %s", filename);
+        exit(EXIT_FAILURE);
+    }
+    if (prover.checkpoints->count == 0) {
+        LOG(FATAL, "no checkpoint in %s", filename);
+        exit(EXIT_FAILURE);
+    }
+    // by default, prove the last checkpoint
+    if (t == 0) {
+        t = prover.checkpoints->items[prover.checkpoints->count - 1].i;
+    }
+    if (t == 0) {
+        LOG(FATAL, "nothing to prove at i = 0");
+        exit(EXIT_FAILURE);
+    }
+
+    // the proof is modulo n of the puzzle recorded with the checkpoints,
+    // which are modulo n*c
+    mpz_init_set(prover.n, prover.checkpoints->n);
+    prover.squarings = 0;
+    prover.n_saved = 0;
+    prover.last_i = 0;
+    mpz_init_set_ui(prover.last_w, 2);
+    prover.starts = malloc(MAX_TERMS * sizeof(*prover.starts));
+    prover.coefficients = malloc(MAX_TERMS * sizeof(*prover.coefficients));
+    prover.saved = malloc(MAX_TERMS * sizeof(*prover.saved));
+    struct proof* proof = proof_new(prover.n, t);
+    if (prover.starts == NULL || prover.coefficients == NULL ||
+            prover.saved == NULL || proof == NULL) {
+        LOG(FATAL, "could not allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t k = 0; k < MAX_TERMS; k += 1) {
+        mpz_init(prover.coefficients[k]);
+        mpz_init(prover.saved[k]);
+    }
+
+    double start = real_clock();
+    prove(&prover, proof);
+    double elapsed = real_clock() - start;
+
+    // a wrong checkpoint gives a proof that does not verify
+    mpz_t w;
+    mpz_init(w);
+    if (!proof_verify(proof, w)) {
+        LOG(FATAL, "the proof does not verify; some checkpoints are wrong "
+            "(see validate)");
+        exit(EXIT_FAILURE);
+    }
+    if (proof_write(proof, proof_filename) < 0) {
+        LOG(FATAL, "failed to write %s", proof_filename);
+        exit(EXIT_FAILURE);
+    }
+    printf("Proof of w = 2^(2^%#" PRIx64 ") mod n written to %s\n", t,
+           proof_filename);
+    printf("%" PRIu64 " squarings done in %.1f s (%.4f%% of t)\n",
+           prover.squarings, elapsed,
+           100 * (double) prover.squarings / (double) t);
+
+    // clean up
+    mpz_clear(w);
+    proof_delete(proof);
+    for (size_t k = 0; k < MAX_TERMS; k += 1) {
+        mpz_clear(prover.saved[k]);
+        mpz_clear(prover.coefficients[k]);
+    }
+    free(prover.saved);
+    free(prover.coefficients);
+    free(prover.starts);
+    mpz_clear(prover.last_w);
+    mpz_clear(prover.n);
+    checkpoints_delete(prover.checkpoints);
+    return EXIT_SUCCESS;
+}
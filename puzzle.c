@@ -0,0 +1,223 @@
+#define _POSIX_C_SOURCE 200809L
+
+// local includes
+#include "oracle.h"
+#include "store.h"
+#include "util.h"
+
+// POSIX
+#include <unistd.h>
+
+// C99
+#include <inttypes.h>
+
+// C90
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// checkpoint writes committed together
+#define STORE_BATCH_SIZE 4096
+
+// size of the seeds of p and q
+#define SEED_BITS 128
+
+static uint64_t next_random(uint64_t* state) {
+    /* splitmix64 */
+    *state += 0x9e3779b97f4a7c15;
+    uint64_t z = *state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+static int create(const char* filename, unsigned prime_bits, uint64_t t,
+                  unsigned spacing, uint64_t n_corrupt, uint64_t seed,
+                  const char* message) {
+    /* Generate a test puzzle and fill a new database with its checkpoints,
+     * every 2^spacing squarings up to t, n_corrupt of them with a bit flipped
+     * for validate to find */
+    struct store* store = store_open(filename, STORE_BATCH_SIZE);
+    if (store == NULL) {
+        return -1;
+    }
+
+    // do not mix checkpoints of different puzzles
+    struct oracle* oracle = oracle_new();
+    uint64_t last_i;
+    mpz_t w;
+    mpz_init(w);
+    if (oracle_load(oracle, store) != 0 || store_last(store, &last_i, w) != 0) {
+        LOG(WARN, "%s already holds a puzzle", filename);
+        goto fail;
+    }
+
+    // large random integers as seeds, as asked for by the Java generator
+    mpz_t p_seed, q_seed;
+    mpz_init(p_seed);
+    mpz_init(q_seed);
+    uint64_t words[SEED_BITS / 64] = {next_random(&seed), next_random(&seed)};
+    mpz_import(p_seed, 2, -1, sizeof(words[0]), 0, 0, words);
+    words[0] = next_random(&seed);
+    words[1] = next_random(&seed);
+    mpz_import(q_seed, 2, -1, sizeof(words[0]), 0, 0, words);
+    int ret = oracle_generate(oracle, prime_bits, p_seed, q_seed, t, message);
+    mpz_clear(q_seed);
+    mpz_clear(p_seed);
+    if (ret < 0 || oracle_save(oracle, store) < 0) {
+        goto fail;
+    }
+
+    // pick the checkpoints to corrupt
+    uint64_t n_checkpoints = t >> spacing;
+    if (n_corrupt > n_checkpoints) {
+        n_corrupt = n_checkpoints;
+    }
+    uint64_t* corrupt = malloc(n_corrupt * sizeof(*corrupt));
+    if (n_corrupt > 0 && corrupt == NULL) {
+        goto fail;
+    }
+    for (uint64_t k = 0; k < n_corrupt; k += 1) {
+        corrupt[k] = (next_random(&seed) % n_checkpoints + 1) << spacing;
+    }
+
+    for (uint64_t k = 1; k <= n_checkpoints; k += 1) {
+        uint64_t i = k << spacing;
+        oracle_w(oracle, i, w);
+        for (uint64_t j = 0; j < n_corrupt; j += 1) {
+            if (corrupt[j] == i) {
+                size_t bit = next_random(&seed) % mpz_sizeinbase(w, 2);
+                mpz_combit(w, bit);
+                printf("corrupted %#.12" PRIx64 " (bit %zu)\n", i, bit);
+                break;
+            }
+        }
+        if (store_write(store, STORE_APPEND, i, w, ORACLE_KERNEL) < 0) {
+            free(corrupt);
+            goto fail;
+        }
+    }
+    free(corrupt);
+
+    gmp_printf("n = %Zd\nt = %" PRIu64 "\nz = %Zd\n", oracle->n, oracle->t,
+               oracle->z);
+    printf("%" PRIu64 " checkpoints written to %s\n", n_checkpoints, filename);
+
+    mpz_clear(w);
+    oracle_delete(oracle);
+    return store_close(store);
+
+fail:
+    mpz_clear(w);
+    oracle_delete(oracle);
+    store_close(store);
+    return -1;
+}
+
+static int query(const char* filename, uint64_t i) {
+    /* Print w at i without computing the i squarings */
+    struct store* store = store_open_existing(filename, 1);
+    if (store == NULL) {
+        return -1;
+    }
+    struct oracle* oracle = oracle_new();
+    int ret = oracle_load(oracle, store);
+    store_close(store);
+    if (ret <= 0) {
+        if (ret == 0) {
+            LOG(WARN, "%s does not hold a test puzzle", filename);
+        }
+        oracle_delete(oracle);
+        return -1;
+    }
+
+    mpz_t w;
+    mpz_init(w);
+    oracle_w(oracle, i, w);
+    gmp_printf("%#" PRIx64 ":%Zd\n", i, w);
+    mpz_clear(w);
+    oracle_delete(oracle);
+    return 0;
+}
+
+static void remove_database(const char* filename) {
+    /* Delete a database along with its WAL files */
+    const char* suffixes[] = {"", "-wal", "-shm"};
+    for (size_t k = 0; k < sizeof(suffixes) / sizeof(*suffixes); k += 1) {
+        size_t size = strlen(filename) + strlen(suffixes[k]) + 1;
+        char* path = malloc(size);
+        if (path == NULL) {
+            return;
+        }
+        snprintf(path, size, "%s%s", filename, suffixes[k]);
+        remove(path);
+        free(path);
+    }
+}
+
+static void usage(const char* name) {
+    LOG(FATAL, "usage: %s create [--bits b] [-t t] [--spacing log2] "
+        "[--corrupt count] [--seed n] [--message text] savefile.db", name);
+    LOG(FATAL, "usage: %s w savefile.db i", name);
+    exit(EXIT_FAILURE);
+}
+
+extern int main(int argc, char** argv) {
+    // parse arguments
+    parse_debug_args(&argc, argv);
+    if (argc == 4 && strcmp(argv[1], "w") == 0) {
+        uint64_t i = strtoull(argv[3], NULL, 0);
+        return query(argv[2], i) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    if (argc < 3 || strcmp(argv[1], "create") != 0) {
+        usage(argv[0]);
+    }
+
+    unsigned long prime_bits = 1024;  // as for LCS35
+    uint64_t t = 1ull << 30;
+    unsigned long spacing = 25;  // as saved by work
+    uint64_t n_corrupt = 0;
+    uint64_t seed = 1;
+    const char* message = "test puzzle";
+    int arg = 2;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "--bits") == 0) {
+            prime_bits = strtoul(argv[arg+1], NULL, 0);
+        } else if (strcmp(argv[arg], "-t") == 0) {
+            t = strtoull(argv[arg+1], NULL, 0);
+        } else if (strcmp(argv[arg], "--spacing") == 0) {
+            spacing = strtoul(argv[arg+1], NULL, 0);
+        } else if (strcmp(argv[arg], "--corrupt") == 0) {
+            n_corrupt = strtoull(argv[arg+1], NULL, 0);
+        } else if (strcmp(argv[arg], "--seed") == 0) {
+            seed = strtoull(argv[arg+1], NULL, 0);
+        } else if (strcmp(argv[arg], "--message") == 0) {
+            message = argv[arg+1];
+        } else {
+            break;
+        }
+        arg += 2;
+    }
+    if (argc != arg + 1 || prime_bits > 1 << 16 || spacing >= 64) {
+        usage(argv[0]);
+    }
+    // the secret, which holds the message, must fit below n
+    unsigned min_bits = oracle_min_prime_bits(message, SEED_BITS);
+    if (prime_bits < min_bits) {
+        LOG(FATAL, "--bits must be at least %u for this message", min_bits);
+        exit(EXIT_FAILURE);
+    }
+
+    // do not leave an empty database behind, but keep an existing one
+    const char* filename = argv[arg];
+    int existed = access(filename, F_OK) == 0;
+    if (create(filename, (unsigned) prime_bits, t, (unsigned) spacing,
+               n_corrupt, seed, message) < 0) {
+        if (!existed) {
+            remove_database(filename);
+        }
+        LOG(FATAL, "failed to create puzzle in %s", filename);
+        exit(EXIT_FAILURE);
+    }
+    return EXIT_SUCCESS;
+}
@@ -182,32 +182,34 @@ extern int session_check(const struct session* session) {
     return 0;
 }
 
-extern int session_load(struct session* session, sqlite3* db) {
+extern int session_parameters(struct session* session, struct store* store) {
+    /* Use the parameters of the test puzzle held by the database, if any
+     *
+     * returns 1 if the database holds a test puzzle
+     * returns 0 if it is for LCS35 itself (session is left unchanged)
+     * returns -1 if an error was encountered */
+    int ret = store_parameters(store, session->n, session->c, &session->t);
+    if (ret > 0) {
+        mpz_mul(session->n_times_c, session->n, session->c);
+    }
+    return ret;
+}
+
+extern int session_load(struct session* session, struct store* store) {
     /* Resume progress from database
      *
      * returns 1 if session was resumed
      * returns 0 if no session was found
      * returns -1 if an error was encountered */
 
-    // load last checkpoint
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(
-            db, "SELECT i, w FROM checkpoint ORDER BY i DESC LIMIT 1", -1,
-            &stmt, NULL) != SQLITE_OK) {
-        LOG(WARN, "sqlite3_prepare_v2: %s", sqlite3_errmsg(db));
+    if (session_parameters(session, store) < 0) {
         return -1;
     }
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        session->i = (uint64_t) sqlite3_column_int64(stmt, 0);
-        const char* w = (const char*) sqlite3_column_text(stmt, 1);
-        if (mpz_set_str(session->w, w, 10) < 0) {
-            LOG(WARN, "invalid decimal number w = %s", w);
-            return -1;
-        }
-    }
-    if (sqlite3_finalize(stmt) != SQLITE_OK) {
-        LOG(WARN, "sqlite3_finalize: %s", sqlite3_errmsg(db));
-        return -1;
+
+    // load last checkpoint
+    int ret = store_last(store, &session->i, session->w);
+    if (ret <= 0) {
+        return ret;
     }
 
     // finally, does the data look good?
@@ -223,105 +225,24 @@ extern int session_load(struct session* session, sqlite3* db) {
     return 1;
 }
 
-extern int session_checkpoint_append(const struct session* session, sqlite3* db) {
+extern int session_checkpoint_append(const struct session* session,
+                                     struct store* store) {
     /* Create a new checkpoint; values were computed for the first time */
-
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(
-            db, "INSERT OR IGNORE INTO checkpoint (i, w) VALUES (?, ?)",
-            -1, &stmt, NULL
-    ) != SQLITE_OK) {
-        LOG(WARN, "sqlite3_prepare_v2: %s", sqlite3_errmsg(db));
-        return -1;
-    }
-    if (sqlite3_bind_int64(stmt, 1, (sqlite_int64) session->i) != SQLITE_OK) {
-        LOG(WARN, "sqlite3_bind_text: %s", sqlite3_errmsg(db));
-        return -1;
-    }
-    char* str_w = mpz_get_str(NULL, 10, session->w);
-    if (str_w == NULL) {
-        LOG(WARN, "failed to convert w to decimal");
-        return -1;
-    }
-    if (sqlite3_bind_text(stmt, 2, str_w, -1, SQLITE_TRANSIENT) != SQLITE_OK) {
-        LOG(WARN, "sqlite3_bind_text: %s", sqlite3_errmsg(db));
-        return -1;
-    }
-    free(str_w);
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(db));
-        return -1;
-    }
-    if (sqlite3_finalize(stmt) != SQLITE_OK) {
-        LOG(WARN, "sqlite3_finalize: %s", sqlite3_errmsg(db));
-        return -1;
-    }
-
-    return 0;
+    return store_write(store, STORE_APPEND, session->i, session->w,
+                       SESSION_KERNEL);
 }
 
-extern int session_checkpoint_insert(const struct session* session, sqlite3* db) {
+extern int session_checkpoint_insert(const struct session* session,
+                                     struct store* store) {
     /* Create a new checkpoint; values were not computed for the first time */
-
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db,
-            "INSERT INTO checkpoint (i, w, first_computed) VALUES (?, ?, NULL)",
-            -1, &stmt, NULL
-    ) != SQLITE_OK) {
-        LOG(WARN, "sqlite3_prepare_v2: %s", sqlite3_errmsg(db));
-        return -1;
-    }
-    if (sqlite3_bind_int64(stmt, 1, (sqlite_int64) session->i) != SQLITE_OK) {
-        LOG(WARN, "sqlite3_bind_text: %s", sqlite3_errmsg(db));
-        return -1;
-    }
-    char* str_w = mpz_get_str(NULL, 10, session->w);
-    if (str_w == NULL) {
-        LOG(WARN, "failed to convert w to decimal");
-        return -1;
-    }
-    if (sqlite3_bind_text(stmt, 2, str_w, -1, SQLITE_TRANSIENT) != SQLITE_OK) {
-        LOG(WARN, "sqlite3_bind_text: %s", sqlite3_errmsg(db));
-        return -1;
-    }
-    free(str_w);
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(db));
-        return -1;
-    }
-    if (sqlite3_finalize(stmt) != SQLITE_OK) {
-        LOG(WARN, "sqlite3_finalize: %s", sqlite3_errmsg(db));
-        return -1;
-    }
-
-    return 0;
+    return store_write(store, STORE_INSERT, session->i, session->w,
+                       SESSION_KERNEL);
 }
 
-extern int session_checkpoint_update(const struct session* session, sqlite3* db) {
+extern int session_checkpoint_update(const struct session* session,
+                                     struct store* store) {
     /* Update last time the values of a checkpoint were computed */
-
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db,
-        "UPDATE checkpoint SET last_computed = CURRENT_TIMESTAMP WHERE i = ?",
-            -1, &stmt, NULL
-    ) != SQLITE_OK) {
-        LOG(WARN, "sqlite3_prepare_v2: %s", sqlite3_errmsg(db));
-        return -1;
-    }
-    if (sqlite3_bind_int64(stmt, 1, (sqlite_int64) session->i) != SQLITE_OK) {
-        LOG(WARN, "sqlite3_bind_text: %s", sqlite3_errmsg(db));
-        return -1;
-    }
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(db));
-        return -1;
-    }
-    if (sqlite3_finalize(stmt) != SQLITE_OK) {
-        LOG(WARN, "sqlite3_finalize: %s", sqlite3_errmsg(db));
-        return -1;
-    }
-
-    return 0;
+    return store_write(store, STORE_UPDATE, session->i, session->w, NULL);
 }
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
@@ -1,13 +1,18 @@
 #ifndef SESSION_H
 #define SESSION_H
 
+// local includes
+#include "store.h"
+
 // external libraries
 #include <gmp.h>
-#include <sqlite3.h>
 
 // C99
 #include <stdint.h>
 
+// name of the implementation of session_work(), recorded by validate
+#define SESSION_KERNEL "mpz_powm"
+
 struct session {
     uint64_t t;  // target exponent
     uint64_t i;  // current exponent
@@ -22,11 +27,15 @@ extern struct session* session_copy(const struct session* session);
 extern void session_delete(struct session* session);
 
 extern int session_check(const struct session* session);  // return 0 if ok
-extern int session_load(struct session* session, sqlite3* db);
-
-extern int session_checkpoint_append(const struct session* session, sqlite3* db);
-extern int session_checkpoint_insert(const struct session* session, sqlite3* db);
-extern int session_checkpoint_update(const struct session* session, sqlite3* db);
+extern int session_parameters(struct session* session, struct store* store);
+extern int session_load(struct session* session, struct store* store);
+
+extern int session_checkpoint_append(const struct session* session,
+                                     struct store* store);
+extern int session_checkpoint_insert(const struct session* session,
+                                     struct store* store);
+extern int session_checkpoint_update(const struct session* session,
+                                     struct store* store);
 
 extern uint64_t session_work(struct session* session, uint64_t amount);
 
@@ -0,0 +1,24 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+// C99
+#include <stdint.h>
+
+// C90
+#include <stddef.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+/* SHA-256 (FIPS 180-4), for deriving challenges in proofs */
+struct sha256 {
+    uint32_t state[8];
+    uint64_t size;  // bytes hashed so far
+    unsigned char block[64];
+};
+
+extern void sha256_init(struct sha256* sha);
+extern void sha256_update(struct sha256* sha, const void* data, size_t size);
+extern void sha256_final(struct sha256* sha,
+                         unsigned char digest[SHA256_DIGEST_SIZE]);
+
+#endif
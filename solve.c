@@ -0,0 +1,205 @@
+#define _POSIX_C_SOURCE 200809L
+
+// local includes
+#include "oracle.h"
+#include "session.h"
+#include "store.h"
+#include "util.h"
+
+// C99
+#include <inttypes.h>
+
+// C90
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// checkpoint verifications committed together
+#define STORE_BATCH_SIZE 4096
+
+// from lcs35-puzzle-description.txt
+#define LCS35_PRIME_BITS 1024
+#define LCS35_Z \
+    "427338526681239414707099486152541907807623930474842759553127" \
+    "699575212802021361367225451651600353733949495680760238284875" \
+    "258690199022379638588291839885522498545851997481849074579523" \
+    "880422628363751913235562086585480775061024927773968205036369" \
+    "669785002263076319003533000450157772067087172252728016627835" \
+    "400463807389033342175518988780339070669313124967596962087173" \
+    "533318107116757443584187074039849389081123568362582652760250" \
+    "029401090870231288509578454981440888629750522601069337564316" \
+    "940360631375375394366442662022050529545706707758321979377282" \
+    "989361374561414204719371297211725179287931039547753581030226" \
+    "7611143659071382"
+
+#define SEED_PREFIX "(seed value b for p = "
+
+static char* decode_secret(const mpz_t w, const mpz_t z, const mpz_t n) {
+    /* Secret message: (w mod n) xor z, 8 bits per character */
+    mpz_t secret;
+    mpz_init(secret);
+    mpz_mod(secret, w, n);
+    mpz_xor(secret, secret, z);
+
+    size_t size = (mpz_sizeinbase(secret, 2) + 7) / 8;
+    char* message = malloc(size + 1);
+    if (message != NULL) {
+        mpz_export(message, &size, 1, 1, 0, 0, secret);
+        message[size] = 0;
+    }
+    mpz_clear(secret);
+    return message;
+}
+
+static int factor(struct oracle* oracle, const char* message) {
+    /* Recover p from the seed given in the message, as in the Java generator,
+     * and q = n / p */
+    const char* str_seed = strstr(message, SEED_PREFIX);
+    if (str_seed == NULL) {
+        LOG(WARN, "no seed in the secret message");
+        return -1;
+    }
+    str_seed += strlen(SEED_PREFIX);
+    size_t length = strspn(str_seed, "0123456789");
+    if (length == 0) {
+        LOG(WARN, "invalid seed in the secret message");
+        return -1;
+    }
+    char* digits = malloc(length + 1);
+    if (digits == NULL) {
+        return -1;
+    }
+    memcpy(digits, str_seed, length);
+    digits[length] = 0;
+
+    mpz_t seed, two_power, p, q;
+    mpz_init_set_str(seed, digits, 10);
+    free(digits);
+    mpz_init(two_power);
+    mpz_init_set_ui(p, 5);
+    mpz_init(q);
+    mpz_setbit(two_power, oracle->prime_bits);
+    mpz_powm(p, p, seed, two_power);
+    oracle_next_prime(p, p);
+
+    int ret = 0;
+    if (!mpz_divisible_p(oracle->n, p)) {
+        LOG(WARN, "the seed does not give a factor of n");
+        ret = -1;
+    } else {
+        mpz_divexact(q, oracle->n, p);
+        if (!mpz_probab_prime_p(q, 40)) {
+            LOG(WARN, "n/p is not prime");
+            ret = -1;
+        } else {
+            oracle_set_factors(oracle, p, q);
+        }
+    }
+    mpz_clear(q);
+    mpz_clear(p);
+    mpz_clear(two_power);
+    mpz_clear(seed);
+    return ret;
+}
+
+static int verify_checkpoints(const struct oracle* oracle,
+                              struct store* store) {
+    /* Compare every checkpoint to the value given by the factorization
+     *
+     * Intervals between consecutive correct checkpoints are recorded as
+     * validated. Returns the number of wrong checkpoints, or -1 on error. */
+    int n_wrong = 0;
+    uint64_t n_checkpoints = 0;
+    uint64_t prev_i = 0;
+    int prev_ok = 1;  // w = 2 at i = 0
+    uint64_t i;
+    mpz_t w, expected;
+    mpz_init(w);
+    mpz_init(expected);
+    int ret;
+    while ((ret = store_next(store, &i, w)) > 0) {
+        oracle_w(oracle, i, expected);
+        int ok = mpz_cmp(w, expected) == 0;
+        if (!ok) {
+            LOG(ERR, "INVALID checkpoint at %#.12" PRIx64, i);
+            n_wrong += 1;
+        }
+        store_validation(store, prev_i, i, ORACLE_KERNEL,
+                         prev_ok && ok);
+        prev_i = i;
+        prev_ok = ok;
+        n_checkpoints += 1;
+    }
+    mpz_clear(expected);
+    mpz_clear(w);
+    if (ret < 0 || store_flush(store) < 0) {
+        return -1;
+    }
+    printf("%" PRIu64 " checkpoints verified, %i INVALID\n", n_checkpoints,
+           n_wrong);
+    return n_wrong;
+}
+
+extern int main(int argc, char** argv) {
+    // parse arguments
+    parse_debug_args(&argc, argv);
+    if (argc != 2) {
+        LOG(FATAL, "usage: %s savefile.db", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    struct store* store = store_open_existing(argv[1],
+                                              STORE_BATCH_SIZE);
+    if (store == NULL) {
+        LOG(FATAL, "failed to open %s", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    // parameters of LCS35, unless this is a test puzzle
+    struct session* session = session_new();
+    struct oracle* oracle = oracle_new();
+    int ret = oracle_load(oracle, store);
+    if (ret < 0 || session_load(session, store) <= 0) {
+        LOG(FATAL, "failed to load %s", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+    if (ret == 0) {
+        oracle->prime_bits = LCS35_PRIME_BITS;
+        oracle->t = session->t;
+        mpz_set(oracle->c, session->c);
+        mpz_set(oracle->n, session->n);
+        mpz_set_str(oracle->z, LCS35_Z, 10);
+    }
+    if (session->i != session->t) {
+        LOG(FATAL, "the last checkpoint is at %#.12" PRIx64 ", not at t = "
+            "%#.12" PRIx64, session->i, session->t);
+        exit(EXIT_FAILURE);
+    }
+
+    char* message = decode_secret(session->w, oracle->z, oracle->n);
+    if (message == NULL) {
+        LOG(FATAL, "could not allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    printf("Secret message: %s\n", message);
+    if (factor(oracle, message) < 0) {
+        LOG(FATAL, "failed to factor n; is the final checkpoint correct?");
+        exit(EXIT_FAILURE);
+    }
+    free(message);
+    gmp_printf("p = %Zd\nq = %Zd\n", oracle->p, oracle->q);
+
+    // with phi(n*c), checking a checkpoint takes two exponentiations
+    ret = verify_checkpoints(oracle, store);
+    if (ret < 0) {
+        LOG(FATAL, "failed to verify checkpoints");
+        exit(EXIT_FAILURE);
+    }
+
+    oracle_delete(oracle);
+    session_delete(session);
+    if (store_close(store) < 0) {
+        LOG(ERR, "failed to save results");
+    }
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
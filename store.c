@@ -0,0 +1,775 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "store.h" // source header
+
+// local includes
+#include "build.h"
+#include "trace.h"
+#include "util.h"
+
+// C99
+#include <inttypes.h>
+
+// C90
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int checkpoint_column_w(mpz_t w, sqlite3_stmt* stmt, int column,
+                               int version_column) {
+    /* Read w from a row of the checkpoint table, in either format */
+    int version = sqlite3_column_int(stmt, version_column);
+    if (version == CHECKPOINT_DECIMAL) {
+        const char* str_w = (const char*) sqlite3_column_text(stmt, column);
+        if (str_w == NULL || mpz_set_str(w, str_w, 10) < 0) {
+            LOG(WARN, "invalid decimal number w = %s", str_w);
+            return -1;
+        }
+        return 0;
+    } else if (version == CHECKPOINT_BINARY) {
+        if (sqlite3_column_type(stmt, column) != SQLITE_BLOB) {
+            LOG(WARN, "binary checkpoint is not stored as a BLOB");
+            return -1;
+        }
+        // the pointer must be obtained before the size (SQLite documentation)
+        const void* blob = sqlite3_column_blob(stmt, column);
+        size_t size = (size_t) sqlite3_column_bytes(stmt, column);
+        mpz_import(w, size, -1, 1, 0, 0, blob);
+        return 0;
+    } else {
+        LOG(WARN, "unknown checkpoint version %i", version);
+        return -1;
+    }
+}
+
+static int checkpoint_bind_w(sqlite3_stmt* stmt, int index, const mpz_t w) {
+    /* Bind w in binary format (little-endian bytes) to a statement */
+    size_t size = (mpz_sizeinbase(w, 2) + 7) / 8;
+    unsigned char* blob = malloc(size);
+    if (blob == NULL) {
+        LOG(WARN, "could not allocate memory (%s)", strerror(errno));
+        return -1;
+    }
+    mpz_export(blob, &size, -1, 1, 0, 0, w);
+    int ret = sqlite3_bind_blob(stmt, index, blob, (int) size, SQLITE_TRANSIENT);
+    free(blob);
+    return ret == SQLITE_OK ? 0 : -1;
+}
+
+static int prepare(sqlite3* db, const char* sql, sqlite3_stmt** stmt) {
+    if (sqlite3_prepare_v2(db, sql, -1, stmt, NULL) != SQLITE_OK) {
+        LOG(WARN, "sqlite3_prepare_v2: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    return 0;
+}
+
+static struct store* open_store(const char* filename, size_t batch_size,
+                                int create) {
+    // allocate memory
+    struct store* store = calloc(1, sizeof(*store));
+    if (store == NULL) {
+        return NULL;
+    }
+    if (batch_size == 0) {
+        batch_size = 1;
+    }
+    store->pending = calloc(batch_size, sizeof(*store->pending));
+    if (store->pending == NULL) {
+        free(store);
+        return NULL;
+    }
+    store->batch_size = batch_size;
+    for (size_t k = 0; k < batch_size; k += 1) {
+        mpz_init(store->pending[k].w);
+    }
+
+    // open database
+    int flags = SQLITE_OPEN_READWRITE | (create ? SQLITE_OPEN_CREATE : 0);
+    if (sqlite3_open_v2(filename, &store->db, flags, NULL) != SQLITE_OK) {
+        LOG(WARN, "sqlite3_open_v2: %s (%s)", sqlite3_errmsg(store->db),
+            filename);
+        store_close(store);
+        return NULL;
+    }
+
+    // with WAL, readers do not block the writer and commits do not need to
+    // wait for fsync(); concurrent writers wait for each other
+    sqlite3_busy_timeout(store->db, 60000);
+    if (sqlite3_exec(store->db, "PRAGMA journal_mode=WAL", NULL, NULL, NULL)
+            != SQLITE_OK ||
+        sqlite3_exec(store->db, "PRAGMA synchronous=NORMAL", NULL, NULL, NULL)
+            != SQLITE_OK) {
+        LOG(WARN, "sqlite3_exec: %s", sqlite3_errmsg(store->db));
+        store_close(store);
+        return NULL;
+    }
+
+    // a database that does not hold checkpoints is most likely not the one
+    // that was meant; the other tables are added to older databases below
+    if (!create) {
+        sqlite3_stmt* stmt;
+        if (prepare(store->db,
+                "SELECT 1 FROM sqlite_master "
+                "WHERE type = 'table' AND name = 'checkpoint'",
+                &stmt) < 0) {
+            store_close(store);
+            return NULL;
+        }
+        int rc = sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        if (rc != SQLITE_ROW) {
+            LOG(WARN, "%s has no checkpoint table", filename);
+            store_close(store);
+            return NULL;
+        }
+    }
+
+    // same schema as created by the supervisor
+    if (sqlite3_exec(store->db,
+            "CREATE TABLE IF NOT EXISTS checkpoint ("
+            "    i INTEGER UNIQUE,"
+            "    w BLOB,"
+            "    version INTEGER DEFAULT 0,"
+            "    first_computed TIMESTAMP DEFAULT CURRENT_TIMESTAMP,"
+            "    last_computed TIMESTAMP DEFAULT CURRENT_TIMESTAMP,"
+            "    host TEXT,"
+            "    kernel TEXT,"
+            "    build TEXT"
+            ")", NULL, NULL, NULL) != SQLITE_OK) {
+        LOG(WARN, "sqlite3_exec: %s", sqlite3_errmsg(store->db));
+        store_close(store);
+        return NULL;
+    }
+
+    // intervals (from_i, to_i] recomputed by validate; result is 1 when the
+    // recomputed w matched the checkpoint at to_i and 0 otherwise; it is NULL
+    // for a sub-interval ending at a sub-checkpoint until the rest of the
+    // interval is compared with a checkpoint
+    if (sqlite3_exec(store->db,
+            "CREATE TABLE IF NOT EXISTS validation ("
+            "    from_i INTEGER,"
+            "    to_i INTEGER,"
+            "    kernel TEXT,"
+            "    result INTEGER,"
+            "    validated TIMESTAMP DEFAULT CURRENT_TIMESTAMP,"
+            "    UNIQUE (from_i, to_i, kernel)"
+            ")", NULL, NULL, NULL) != SQLITE_OK) {
+        LOG(WARN, "sqlite3_exec: %s", sqlite3_errmsg(store->db));
+        store_close(store);
+        return NULL;
+    }
+
+    // parameters of a test puzzle (see puzzle.c); empty for LCS35 itself
+    if (sqlite3_exec(store->db,
+            "CREATE TABLE IF NOT EXISTS parameter ("
+            "    n TEXT,"
+            "    c TEXT,"
+            "    t INTEGER,"
+            "    z TEXT,"
+            "    p TEXT,"
+            "    q TEXT,"
+            "    prime_bits INTEGER"
+            ")", NULL, NULL, NULL) != SQLITE_OK) {
+        LOG(WARN, "sqlite3_exec: %s", sqlite3_errmsg(store->db));
+        store_close(store);
+        return NULL;
+    }
+
+    if (prepare(store->db,
+            "SELECT i, w, version FROM checkpoint ORDER BY i DESC LIMIT 1",
+            &store->stmt_last) < 0 ||
+        prepare(store->db,
+            "SELECT i, w, version, host, kernel, build, first_computed, "
+            "last_computed FROM checkpoint ORDER BY i",
+            &store->stmt_all) < 0 ||
+        prepare(store->db,
+            "INSERT OR IGNORE INTO checkpoint (i, w, version, kernel, build) "
+            "VALUES (?, ?, 1, ?, ?)",
+            &store->stmt_append) < 0 ||
+        prepare(store->db,
+            "INSERT OR IGNORE INTO checkpoint "
+            "(i, w, version, first_computed, kernel, build) "
+            "VALUES (?, ?, 1, NULL, ?, ?)",
+            &store->stmt_insert) < 0 ||
+        prepare(store->db,
+            "UPDATE checkpoint SET last_computed = CURRENT_TIMESTAMP "
+            "WHERE i = ?",
+            &store->stmt_update) < 0 ||
+        prepare(store->db,
+            "INSERT OR REPLACE INTO validation (from_i, to_i, kernel, result) "
+            "VALUES (?, ?, ?, ?)",
+            &store->stmt_validation) < 0 ||
+        prepare(store->db,
+            "SELECT from_i, to_i, result IS NULL FROM validation "
+            "WHERE result = 1 OR result IS NULL ORDER BY from_i, to_i",
+            &store->stmt_validated) < 0 ||
+        prepare(store->db,
+            "WITH RECURSIVE chain(from_i, to_i) AS ("
+            "    SELECT from_i, to_i FROM validation "
+            "    WHERE result IS NULL AND to_i = ?1 "
+            "    UNION SELECT validation.from_i, validation.to_i "
+            "    FROM validation, chain "
+            "    WHERE validation.result IS NULL AND "
+            "          validation.to_i = chain.from_i) "
+            "DELETE FROM checkpoint "
+            "WHERE first_computed IS NULL AND i IN (SELECT to_i FROM chain)",
+            &store->stmt_discard) < 0 ||
+        prepare(store->db,
+            "WITH RECURSIVE chain(id, from_i) AS ("
+            "    SELECT rowid, from_i FROM validation "
+            "    WHERE result IS NULL AND to_i = ?1 "
+            "    UNION SELECT validation.rowid, validation.from_i "
+            "    FROM validation, chain "
+            "    WHERE validation.result IS NULL AND "
+            "          validation.to_i = chain.from_i) "
+            "UPDATE validation SET result = ?2 "
+            "WHERE rowid IN (SELECT id FROM chain)",
+            &store->stmt_resolve) < 0 ||
+        prepare(store->db,
+            "INSERT OR IGNORE INTO checkpoint (i, w, version, host, kernel, "
+            "build, first_computed, last_computed) "
+            "VALUES (?, ?, 1, ?, ?, ?, ?, ?)",
+            &store->stmt_restore) < 0 ||
+        prepare(store->db,
+            "INSERT OR IGNORE INTO validation "
+            "(from_i, to_i, kernel, result, validated) VALUES (?, ?, ?, ?, ?)",
+            &store->stmt_restore_validation) < 0 ||
+        prepare(store->db,
+            "SELECT from_i, to_i, result, kernel, validated FROM validation "
+            "ORDER BY from_i, to_i",
+            &store->stmt_validations) < 0) {
+        store_close(store);
+        return NULL;
+    }
+
+    return store;
+}
+
+extern struct store* store_open(const char* filename, size_t batch_size) {
+    /* Open a database, creating it if needed */
+    return open_store(filename, batch_size, 1);
+}
+
+extern struct store* store_open_existing(const char* filename,
+                                         size_t batch_size) {
+    /* Open a database that must already hold a checkpoint table, for the
+     * tools that work on the checkpoints of a run */
+    return open_store(filename, batch_size, 0);
+}
+
+extern int store_close(struct store* store) {
+    /* Flush pending writes and release the store */
+    int ret = 0;
+    if (store->db != NULL && store_flush(store) < 0) {
+        ret = -1;
+    }
+
+    // sqlite3_finalize() accepts NULL statements
+    sqlite3_finalize(store->stmt_validations);
+    sqlite3_finalize(store->stmt_restore_validation);
+    sqlite3_finalize(store->stmt_restore);
+    sqlite3_finalize(store->stmt_resolve);
+    sqlite3_finalize(store->stmt_discard);
+    sqlite3_finalize(store->stmt_validated);
+    sqlite3_finalize(store->stmt_validation);
+    sqlite3_finalize(store->stmt_update);
+    sqlite3_finalize(store->stmt_insert);
+    sqlite3_finalize(store->stmt_append);
+    sqlite3_finalize(store->stmt_all);
+    sqlite3_finalize(store->stmt_last);
+    if (sqlite3_close(store->db) != SQLITE_OK) {
+        LOG(WARN, "sqlite3_close: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    }
+
+    for (size_t k = 0; k < store->batch_size; k += 1) {
+        mpz_clear(store->pending[k].w);
+    }
+    free(store->pending);
+    free(store);
+    return ret;
+}
+
+extern int store_last(struct store* store, uint64_t* i, mpz_t w) {
+    /* Read the most recent checkpoint
+     *
+     * returns 1 if a checkpoint was found
+     * returns 0 if there is no checkpoint
+     * returns -1 if an error was encountered */
+    int ret = 0;
+    trace_begin("store_last");
+    int rc = sqlite3_step(store->stmt_last);
+    if (rc == SQLITE_ROW) {
+        *i = (uint64_t) sqlite3_column_int64(store->stmt_last, 0);
+        if (checkpoint_column_w(w, store->stmt_last, 1, 2) < 0) {
+            LOG(WARN, "invalid value for w at i = %#" PRIx64, *i);
+            ret = -1;
+        } else {
+            ret = 1;
+        }
+    } else if (rc != SQLITE_DONE) {
+        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    }
+    sqlite3_reset(store->stmt_last);
+    trace_end("store_last");
+    return ret;
+}
+
+extern int store_next(struct store* store, uint64_t* i, mpz_t w) {
+    /* Iterate over all checkpoints in increasing order of i
+     *
+     * returns 1 if a checkpoint was read
+     * returns 0 once all checkpoints have been read
+     * returns -1 if an error was encountered */
+
+    // sqlite3_step() would silently restart the query after SQLITE_DONE
+    if (store->all_done) {
+        return 0;
+    }
+
+    int rc = sqlite3_step(store->stmt_all);
+    if (rc == SQLITE_DONE) {
+        store->all_done = 1;
+        sqlite3_reset(store->stmt_all);
+        return 0;
+    } else if (rc != SQLITE_ROW) {
+        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(store->db));
+        return -1;
+    }
+
+    *i = (uint64_t) sqlite3_column_int64(store->stmt_all, 0);
+    if (checkpoint_column_w(w, store->stmt_all, 1, 2) < 0) {
+        LOG(WARN, "invalid value for w at i = %#" PRIx64, *i);
+        return -1;
+    }
+    return 1;
+}
+
+extern int store_parameters(struct store* store, mpz_t n, mpz_t c,
+                            uint64_t* t) {
+    /* Read the modulus, control prime and target of a test puzzle
+     *
+     * returns 1 if the database holds a test puzzle
+     * returns 0 if it is for LCS35 itself
+     * returns -1 if an error was encountered */
+    sqlite3_stmt* stmt;
+    if (prepare(store->db, "SELECT n, c, t FROM parameter LIMIT 1",
+                &stmt) < 0) {
+        return -1;
+    }
+    int ret = 0;
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        const char* str_n = (const char*) sqlite3_column_text(stmt, 0);
+        const char* str_c = (const char*) sqlite3_column_text(stmt, 1);
+        *t = (uint64_t) sqlite3_column_int64(stmt, 2);
+        if (str_n == NULL || mpz_set_str(n, str_n, 10) < 0 ||
+                str_c == NULL || mpz_set_str(c, str_c, 10) < 0) {
+            LOG(WARN, "invalid puzzle parameters");
+            ret = -1;
+        } else {
+            ret = 1;
+        }
+    } else if (rc != SQLITE_DONE) {
+        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    }
+    sqlite3_finalize(stmt);
+    return ret;
+}
+
+extern int store_set_parameters(struct store* store, const mpz_t n,
+                                const mpz_t c, uint64_t t) {
+    /* Record the modulus, control prime and target of a test puzzle */
+    sqlite3_stmt* stmt;
+    if (prepare(store->db, "INSERT INTO parameter (n, c, t) VALUES (?, ?, ?)",
+                &stmt) < 0) {
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, mpz_get_str(NULL, 10, n), -1, free);
+    sqlite3_bind_text(stmt, 2, mpz_get_str(NULL, 10, c), -1, free);
+    sqlite3_bind_int64(stmt, 3, (sqlite_int64) t);
+    int ret = 0;
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    }
+    sqlite3_finalize(stmt);
+    return ret;
+}
+
+static struct store_write* reserve_write(struct store* store) {
+    // a previous flush might have failed to begin and left the batch full
+    if (store->n_pending == store->batch_size && store_flush(store) < 0) {
+        return NULL;
+    }
+    return &store->pending[store->n_pending];
+}
+
+static int commit_write(struct store* store) {
+    // commit the batch if it is full
+    store->n_pending += 1;
+    if (store->n_pending == store->batch_size) {
+        return store_flush(store);
+    }
+    return 0;
+}
+
+extern const char* store_host(struct store* store) {
+    /* Worker host that produced the checkpoint last read by store_next()
+     *
+     * returns NULL if unknown; valid until the next call to store_next() */
+    return (const char*) sqlite3_column_text(store->stmt_all, 3);
+}
+
+extern const char* store_kernel(struct store* store) {
+    /* Implementation that computed the checkpoint last read by store_next()
+     *
+     * returns NULL if unknown; valid until the next call to store_next() */
+    return (const char*) sqlite3_column_text(store->stmt_all, 4);
+}
+
+extern void store_metadata(struct store* store,
+                           struct store_metadata* metadata) {
+    /* Other columns of the checkpoint last read by store_next()
+     *
+     * the strings are valid until the next call to store_next() */
+    sqlite3_stmt* stmt = store->stmt_all;
+    metadata->host = (const char*) sqlite3_column_text(stmt, 3);
+    metadata->kernel = (const char*) sqlite3_column_text(stmt, 4);
+    metadata->build = (const char*) sqlite3_column_text(stmt, 5);
+    metadata->first_computed = (const char*) sqlite3_column_text(stmt, 6);
+    metadata->last_computed = (const char*) sqlite3_column_text(stmt, 7);
+}
+
+extern int store_next_validated(struct store* store, uint64_t* from_i,
+                                uint64_t* to_i, int* pending) {
+    /* Iterate over successfully validated intervals, by increasing from_i
+     *
+     * pending is set for the sub-intervals whose result is not known yet
+     *
+     * returns 1 if an interval was read
+     * returns 0 once all intervals have been read
+     * returns -1 if an error was encountered */
+    if (store->validated_done) {
+        return 0;
+    }
+
+    int rc = sqlite3_step(store->stmt_validated);
+    if (rc == SQLITE_DONE) {
+        store->validated_done = 1;
+        sqlite3_reset(store->stmt_validated);
+        return 0;
+    } else if (rc != SQLITE_ROW) {
+        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(store->db));
+        return -1;
+    }
+
+    *from_i = (uint64_t) sqlite3_column_int64(store->stmt_validated, 0);
+    *to_i = (uint64_t) sqlite3_column_int64(store->stmt_validated, 1);
+    *pending = sqlite3_column_int(store->stmt_validated, 2);
+    return 1;
+}
+
+extern int store_next_validation(struct store* store, uint64_t* from_i,
+                                 uint64_t* to_i, int* result,
+                                 const char** kernel, const char** validated) {
+    /* Iterate over all rows of the validation table, by increasing from_i
+     *
+     * result is STORE_PENDING for the sub-intervals whose result is not known
+     * yet; the strings are valid until the next call
+     *
+     * returns 1 if a row was read
+     * returns 0 once all rows have been read
+     * returns -1 if an error was encountered */
+    if (store->validations_done) {
+        return 0;
+    }
+
+    sqlite3_stmt* stmt = store->stmt_validations;
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_DONE) {
+        store->validations_done = 1;
+        sqlite3_reset(stmt);
+        return 0;
+    } else if (rc != SQLITE_ROW) {
+        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(store->db));
+        return -1;
+    }
+
+    *from_i = (uint64_t) sqlite3_column_int64(stmt, 0);
+    *to_i = (uint64_t) sqlite3_column_int64(stmt, 1);
+    *result = sqlite3_column_type(stmt, 2) == SQLITE_NULL ? STORE_PENDING :
+              sqlite3_column_int(stmt, 2);
+    *kernel = (const char*) sqlite3_column_text(stmt, 3);
+    *validated = (const char*) sqlite3_column_text(stmt, 4);
+    return 1;
+}
+
+extern int store_write(struct store* store, enum store_op op, uint64_t i,
+                       const mpz_t w, const char* kernel) {
+    /* Queue a write to the checkpoint table
+     *
+     * kernel is the implementation that computed w, NULL if unknown; it is
+     * recorded along with build_revision by STORE_APPEND and STORE_INSERT,
+     * and must remain valid until the write is committed */
+    struct store_write* write = reserve_write(store);
+    if (write == NULL) {
+        return -1;
+    }
+    write->op = op;
+    write->i = i;
+    if (op != STORE_UPDATE) {
+        mpz_set(write->w, w);
+    }
+    write->kernel = kernel;
+    return commit_write(store);
+}
+
+extern int store_validation(struct store* store, uint64_t from_i,
+                            uint64_t to_i, const char* kernel, int result) {
+    /* Queue the result of recomputing w at to_i from w at from_i
+     *
+     * result is 1 if it matched the checkpoint at to_i, 0 if it did not, and
+     * STORE_PENDING if to_i is a sub-checkpoint derived on the way to the
+     * next checkpoint. A known result is also given to the chain of pending
+     * sub-intervals that ends at from_i; when it is 0, their sub-checkpoints
+     * are deleted. kernel must remain valid until the write is committed */
+    struct store_write* write = reserve_write(store);
+    if (write == NULL) {
+        return -1;
+    }
+    write->op = STORE_VALIDATION;
+    write->from_i = from_i;
+    write->i = to_i;
+    write->kernel = kernel;
+    write->result = result;
+    return commit_write(store);
+}
+
+extern int store_restore(struct store* store, uint64_t i, const mpz_t w,
+                         const struct store_metadata* metadata) {
+    /* Queue a checkpoint copied from another database with the rest of its
+     * row; an existing checkpoint at i is kept. The strings of metadata must
+     * remain valid until the write is committed */
+    struct store_write* write = reserve_write(store);
+    if (write == NULL) {
+        return -1;
+    }
+    write->op = STORE_RESTORE;
+    write->i = i;
+    mpz_set(write->w, w);
+    write->metadata = *metadata;
+    return commit_write(store);
+}
+
+extern int store_restore_validation(struct store* store, uint64_t from_i,
+                                    uint64_t to_i, const char* kernel,
+                                    int result, const char* validated) {
+    /* Queue a row of the validation table copied from another database, as
+     * read by store_next_validation(); an existing row is kept. The strings
+     * must remain valid until the write is committed */
+    struct store_write* write = reserve_write(store);
+    if (write == NULL) {
+        return -1;
+    }
+    write->op = STORE_RESTORE_VALIDATION;
+    write->from_i = from_i;
+    write->i = to_i;
+    write->kernel = kernel;
+    write->result = result;
+    write->validated = validated;
+    return commit_write(store);
+}
+
+static int execute_chain(struct store* store, sqlite3_stmt* stmt,
+                         const struct store_write* write) {
+    /* Run stmt_discard or stmt_resolve on the chain ending at from_i */
+    int ret = 0;
+    if (sqlite3_bind_int64(stmt, 1, (sqlite_int64) write->from_i) != SQLITE_OK ||
+        (stmt == store->stmt_resolve &&
+         sqlite3_bind_int(stmt, 2, write->result) != SQLITE_OK)) {
+        LOG(WARN, "sqlite3_bind: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    } else if (sqlite3_step(stmt) != SQLITE_DONE) {
+        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return ret;
+}
+
+static int execute_validation(struct store* store,
+                              const struct store_write* write) {
+    // sub-checkpoints are only trusted once the end of the interval matched
+    if (write->result != STORE_PENDING) {
+        if (write->result == 0 &&
+                execute_chain(store, store->stmt_discard, write) < 0) {
+            return -1;
+        }
+        if (execute_chain(store, store->stmt_resolve, write) < 0) {
+            return -1;
+        }
+    }
+
+    sqlite3_stmt* stmt = store->stmt_validation;
+    int ret = 0;
+    if (sqlite3_bind_int64(stmt, 1, (sqlite_int64) write->from_i) != SQLITE_OK ||
+        sqlite3_bind_int64(stmt, 2, (sqlite_int64) write->i) != SQLITE_OK ||
+        sqlite3_bind_text(stmt, 3, write->kernel, -1, SQLITE_STATIC)
+            != SQLITE_OK ||
+        (write->result == STORE_PENDING ?
+            sqlite3_bind_null(stmt, 4) :
+            sqlite3_bind_int(stmt, 4, write->result)) != SQLITE_OK) {
+        LOG(WARN, "sqlite3_bind: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    } else if (sqlite3_step(stmt) != SQLITE_DONE) {
+        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return ret;
+}
+
+static int execute_restore(struct store* store,
+                           const struct store_write* write) {
+    // bind the columns as they were; NULL text binds NULL
+    sqlite3_stmt* stmt;
+    int rc;
+    if (write->op == STORE_RESTORE) {
+        stmt = store->stmt_restore;
+        const struct store_metadata* metadata = &write->metadata;
+        rc = sqlite3_bind_int64(stmt, 1, (sqlite_int64) write->i);
+        if (rc == SQLITE_OK && checkpoint_bind_w(stmt, 2, write->w) < 0) {
+            rc = SQLITE_ERROR;
+        }
+        const char* columns[] = {
+            metadata->host, metadata->kernel, metadata->build,
+            metadata->first_computed, metadata->last_computed,
+        };
+        for (int k = 0; rc == SQLITE_OK && k < 5; k += 1) {
+            rc = sqlite3_bind_text(stmt, 3 + k, columns[k], -1,
+                                   SQLITE_STATIC);
+        }
+    } else {
+        stmt = store->stmt_restore_validation;
+        rc = sqlite3_bind_int64(stmt, 1, (sqlite_int64) write->from_i);
+        if (rc == SQLITE_OK) {
+            rc = sqlite3_bind_int64(stmt, 2, (sqlite_int64) write->i);
+        }
+        if (rc == SQLITE_OK) {
+            rc = sqlite3_bind_text(stmt, 3, write->kernel, -1, SQLITE_STATIC);
+        }
+        if (rc == SQLITE_OK) {
+            rc = write->result == STORE_PENDING ?
+                sqlite3_bind_null(stmt, 4) :
+                sqlite3_bind_int(stmt, 4, write->result);
+        }
+        if (rc == SQLITE_OK) {
+            rc = sqlite3_bind_text(stmt, 5, write->validated, -1,
+                                   SQLITE_STATIC);
+        }
+    }
+
+    int ret = 0;
+    if (rc != SQLITE_OK) {
+        LOG(WARN, "sqlite3_bind: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    } else if (sqlite3_step(stmt) != SQLITE_DONE) {
+        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return ret;
+}
+
+static int execute_write(struct store* store, const struct store_write* write) {
+    if (write->op == STORE_VALIDATION) {
+        return execute_validation(store, write);
+    }
+    if (write->op == STORE_RESTORE || write->op == STORE_RESTORE_VALIDATION) {
+        return execute_restore(store, write);
+    }
+
+    sqlite3_stmt* stmt;
+    switch (write->op) {
+    case STORE_APPEND: stmt = store->stmt_append; break;
+    case STORE_INSERT: stmt = store->stmt_insert; break;
+    case STORE_UPDATE: stmt = store->stmt_update; break;
+    default: return -1;
+    }
+
+    int ret = 0;
+    if (sqlite3_bind_int64(stmt, 1, (sqlite_int64) write->i) != SQLITE_OK) {
+        LOG(WARN, "sqlite3_bind_int64: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    } else if (write->op != STORE_UPDATE &&
+               checkpoint_bind_w(stmt, 2, write->w) < 0) {
+        LOG(WARN, "sqlite3_bind_blob: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    } else if (write->op != STORE_UPDATE && write->kernel != NULL &&
+               (sqlite3_bind_text(stmt, 3, write->kernel, -1, SQLITE_STATIC)
+                    != SQLITE_OK ||
+                sqlite3_bind_text(stmt, 4, build_revision, -1,
+                                  SQLITE_STATIC)
+                    != SQLITE_OK)) {
+        LOG(WARN, "sqlite3_bind_text: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    } else if (sqlite3_step(stmt) != SQLITE_DONE) {
+        LOG(WARN, "sqlite3_step: %s", sqlite3_errmsg(store->db));
+        ret = -1;
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return ret;
+}
+
+extern int store_flush(struct store* store) {
+    /* Commit all pending writes in a single transaction
+     *
+     * If one of them fails, the transaction is rolled back and the whole
+     * batch is dropped; it is kept for another try if the transaction could
+     * not even begin */
+    if (store->n_pending == 0) {
+        return 0;
+    }
+
+    // take the write lock immediately to avoid upgrade deadlocks; waiting
+    // for another connection shows as a long BEGIN IMMEDIATE
+    trace_begin("BEGIN IMMEDIATE");
+    int rc = sqlite3_exec(store->db, "BEGIN IMMEDIATE", NULL, NULL, NULL);
+    trace_end("BEGIN IMMEDIATE");
+    if (rc != SQLITE_OK) {
+        LOG(WARN, "sqlite3_exec: %s", sqlite3_errmsg(store->db));
+        return -1;
+    }
+    trace_begin("store_flush");
+    int ret = 0;
+    for (size_t k = 0; k < store->n_pending; k += 1) {
+        if (execute_write(store, &store->pending[k]) < 0) {
+            sqlite3_exec(store->db, "ROLLBACK", NULL, NULL, NULL);
+            ret = -1;
+            break;
+        }
+    }
+    if (ret == 0 &&
+            sqlite3_exec(store->db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+        LOG(WARN, "sqlite3_exec: %s", sqlite3_errmsg(store->db));
+        sqlite3_exec(store->db, "ROLLBACK", NULL, NULL, NULL);
+        ret = -1;
+    }
+    trace_end("store_flush");
+
+    // once rolled back, the same batch would fail again, and so would every
+    // later one that includes it
+    if (ret < 0) {
+        LOG(WARN, "dropped %zu pending writes", store->n_pending);
+    }
+    store->n_pending = 0;
+    return ret;
+}
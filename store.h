@@ -0,0 +1,119 @@
+#ifndef STORE_H
+#define STORE_H
+
+// external libraries
+#include <gmp.h>
+#include <sqlite3.h>
+
+// C99
+#include <stdint.h>
+
+// C90
+#include <stddef.h>
+
+// storage format of w in the checkpoint table (column version)
+enum checkpoint_version {
+    CHECKPOINT_DECIMAL = 0,  // TEXT in base 10
+    CHECKPOINT_BINARY = 1,  // BLOB of little-endian bytes (mpz_export)
+};
+
+enum store_op {
+    STORE_APPEND,  // new checkpoint, computed for the first time
+    STORE_INSERT,  // new checkpoint, recomputed from an earlier one
+    STORE_UPDATE,  // existing checkpoint was computed again
+    STORE_VALIDATION,  // result of recomputing an interval
+    STORE_RESTORE,  // checkpoint copied from another database, as it was
+    STORE_RESTORE_VALIDATION,  // validation row copied likewise
+};
+
+// result of a sub-interval whose end is not yet compared with a checkpoint
+#define STORE_PENDING -1
+
+// columns of a checkpoint row besides i and w, NULL when unknown
+struct store_metadata {
+    const char* host;
+    const char* kernel;
+    const char* build;
+    const char* first_computed;  // NULL for a checkpoint derived by validate
+    const char* last_computed;
+};
+
+struct store_write {
+    enum store_op op;
+    uint64_t i;
+    mpz_t w;
+    // for STORE_APPEND and STORE_INSERT, the implementation that computed w;
+    // for STORE_VALIDATION, the one that recomputed the interval
+    const char* kernel;
+    // for STORE_VALIDATION and STORE_RESTORE_VALIDATION; i is the end of
+    // the interval
+    uint64_t from_i;
+    int result;
+    // for STORE_RESTORE, the rest of the row; for STORE_RESTORE_VALIDATION,
+    // when the interval was validated
+    struct store_metadata metadata;
+    const char* validated;
+};
+
+/* Checkpoint store
+ *
+ * Owns a connection to the database along with its prepared statements. A
+ * store must only be used by one thread at a time; threads that write
+ * concurrently should each open their own. Writes are queued and committed
+ * together in a single transaction once batch_size of them are pending, or
+ * on store_flush() and store_close(). */
+struct store {
+    sqlite3* db;
+    sqlite3_stmt* stmt_last;
+    sqlite3_stmt* stmt_all;
+    sqlite3_stmt* stmt_append;
+    sqlite3_stmt* stmt_insert;
+    sqlite3_stmt* stmt_update;
+    sqlite3_stmt* stmt_validation;
+    sqlite3_stmt* stmt_validated;
+    sqlite3_stmt* stmt_discard;
+    sqlite3_stmt* stmt_resolve;
+    sqlite3_stmt* stmt_restore;
+    sqlite3_stmt* stmt_restore_validation;
+    sqlite3_stmt* stmt_validations;
+    int all_done;  // stmt_all returned SQLITE_DONE
+    int validated_done;  // stmt_validated returned SQLITE_DONE
+    int validations_done;  // stmt_validations returned SQLITE_DONE
+    struct store_write* pending;
+    size_t n_pending;
+    size_t batch_size;
+};
+
+extern struct store* store_open(const char* filename, size_t batch_size);
+extern struct store* store_open_existing(const char* filename,
+                                         size_t batch_size);
+extern int store_close(struct store* store);
+
+extern int store_last(struct store* store, uint64_t* i, mpz_t w);
+extern int store_next(struct store* store, uint64_t* i, mpz_t w);
+extern const char* store_host(struct store* store);
+extern const char* store_kernel(struct store* store);
+extern void store_metadata(struct store* store,
+                           struct store_metadata* metadata);
+extern int store_parameters(struct store* store, mpz_t n, mpz_t c,
+                            uint64_t* t);
+extern int store_set_parameters(struct store* store, const mpz_t n,
+                                const mpz_t c, uint64_t t);
+extern int store_next_validated(struct store* store, uint64_t* from_i,
+                                uint64_t* to_i, int* pending);
+extern int store_next_validation(struct store* store, uint64_t* from_i,
+                                 uint64_t* to_i, int* result,
+                                 const char** kernel, const char** validated);
+
+extern int store_write(struct store* store, enum store_op op, uint64_t i,
+                       const mpz_t w, const char* kernel);
+extern int store_validation(struct store* store, uint64_t from_i,
+                            uint64_t to_i, const char* kernel, int result);
+extern int store_restore(struct store* store, uint64_t i, const mpz_t w,
+                         const struct store_metadata* metadata);
+extern int store_restore_validation(struct store* store, uint64_t from_i,
+                                    uint64_t to_i, const char* kernel,
+                                    int result, const char* validated);
+extern int store_flush(struct store* store);
+
+#endif
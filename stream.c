@@ -0,0 +1,436 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "stream.h" // source header
+
+// local includes
+#include "bundle.h"
+#include "trace.h"
+#include "util.h"
+
+// POSIX
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// C99
+#include <inttypes.h>
+
+// C90
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void put_u32(unsigned char* p, uint32_t v) {
+    for (int k = 0; k < 4; k += 1) {
+        p[k] = (unsigned char) (v >> (8 * k));
+    }
+}
+
+static void put_u64(unsigned char* p, uint64_t v) {
+    for (int k = 0; k < 8; k += 1) {
+        p[k] = (unsigned char) (v >> (8 * k));
+    }
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    uint32_t v = 0;
+    for (int k = 3; k >= 0; k -= 1) {
+        v = (v << 8) | p[k];
+    }
+    return v;
+}
+
+static uint64_t get_u64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int k = 7; k >= 0; k -= 1) {
+        v = (v << 8) | p[k];
+    }
+    return v;
+}
+
+struct header {
+    size_t w_size;
+    size_t size;  // of the header and the puzzle: where records start
+    unsigned char* puzzle;  // NULL for a version 1 stream
+    size_t n_size;
+    size_t c_size;
+    uint64_t t;
+};
+
+static int read_header(int fd, const char* filename, struct header* header) {
+    /* Read the header and the puzzle at the start of a stream
+     *
+     * returns -1 if they are not valid; otherwise, header->puzzle must be
+     * freed by the caller */
+    unsigned char fixed[STREAM_HEADER_SIZE];
+    if (read(fd, fixed, STREAM_V1_HEADER_SIZE) != STREAM_V1_HEADER_SIZE) {
+        LOG(WARN, "%s is too short to be a checkpoint stream", filename);
+        return -1;
+    }
+    if (memcmp(fixed, STREAM_MAGIC, 8) != 0) {
+        LOG(WARN, "%s is not a checkpoint stream", filename);
+        return -1;
+    }
+    uint32_t version = get_u32(fixed + 8);
+    if (version != 1 && version != STREAM_VERSION) {
+        LOG(WARN, "unsupported stream version %" PRIu32, version);
+        return -1;
+    }
+    header->w_size = get_u32(fixed + 12);
+    if (header->w_size == 0 || header->w_size > 1 << 20) {
+        LOG(WARN, "invalid record size in %s", filename);
+        return -1;
+    }
+    header->size = STREAM_V1_HEADER_SIZE;
+    header->puzzle = NULL;
+    if (version == 1) {
+        return 0;
+    }
+
+    size_t rest = STREAM_HEADER_SIZE - STREAM_V1_HEADER_SIZE;
+    if (read(fd, fixed + STREAM_V1_HEADER_SIZE, rest) != (ssize_t) rest) {
+        LOG(WARN, "%s is too short to be a checkpoint stream", filename);
+        return -1;
+    }
+    header->t = get_u64(fixed + 16);
+    header->n_size = get_u32(fixed + 24);
+    header->c_size = get_u32(fixed + 28);
+    if (header->n_size > 1 << 20 || header->c_size > 1 << 20) {
+        LOG(WARN, "invalid puzzle size in %s", filename);
+        return -1;
+    }
+    size_t puzzle_size = bundle_puzzle_size(header->n_size, header->c_size);
+    header->puzzle = malloc(puzzle_size);
+    if (header->puzzle == NULL) {
+        return -1;
+    }
+    if (read(fd, header->puzzle, puzzle_size) != (ssize_t) puzzle_size) {
+        LOG(WARN, "%s is too short to be a checkpoint stream", filename);
+        free(header->puzzle);
+        return -1;
+    }
+    if (get_u32(fixed + 32) !=
+            crc32(crc32(0, fixed, 32), header->puzzle, puzzle_size)) {
+        LOG(WARN, "corrupted stream header in %s", filename);
+        free(header->puzzle);
+        return -1;
+    }
+    header->size = STREAM_HEADER_SIZE + puzzle_size;
+    return 0;
+}
+
+extern int stream_probe(const char* filename) {
+    /* Return 1 if the file looks like a checkpoint stream */
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) {
+        return 0;
+    }
+    char magic[8];
+    size_t n = fread(magic, 1, sizeof(magic), f);
+    fclose(f);
+    return n == sizeof(magic) && memcmp(magic, STREAM_MAGIC, 8) == 0;
+}
+
+extern struct stream* stream_open(const char* filename) {
+    struct stream* stream = calloc(1, sizeof(*stream));
+    if (stream == NULL) {
+        return NULL;
+    }
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        LOG(WARN, "failed to open %s (%s)", filename, strerror(errno));
+        free(stream);
+        return NULL;
+    }
+
+    // records are then read from where the header ends
+    struct header header;
+    if (read_header(fd, filename, &header) < 0) {
+        close(fd);
+        free(stream);
+        return NULL;
+    }
+    stream->w_size = header.w_size;
+    stream->puzzle = header.puzzle;
+    stream->n_size = header.n_size;
+    stream->c_size = header.c_size;
+    stream->t = header.t;
+    stream->record_size = bundle_record_size(stream->w_size);
+    stream->record = malloc(stream->record_size);
+    stream->file = fdopen(fd, "rb");
+    if (stream->record == NULL || stream->file == NULL) {
+        if (stream->file != NULL) {
+            fclose(stream->file);
+        } else {
+            close(fd);
+        }
+        free(stream->record);
+        free(stream->puzzle);
+        free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+extern int stream_parameters(const struct stream* stream, mpz_t n, mpz_t c,
+                             uint64_t* t) {
+    /* Read the modulus, control prime and target of the puzzle
+     *
+     * returns 1 if the stream records them
+     * returns 0 for a version 1 stream, which is for LCS35 itself */
+    if (stream->puzzle == NULL) {
+        return 0;
+    }
+    mpz_import(n, stream->n_size, -1, 1, 0, 0, stream->puzzle);
+    mpz_import(c, stream->c_size, -1, 1, 0, 0,
+               stream->puzzle + stream->n_size);
+    *t = stream->t;
+    return 1;
+}
+
+extern int stream_next(struct stream* stream, uint64_t* i, mpz_t w) {
+    /* Read the next record; return 1 on success, 0 when none is left
+     *
+     * Corrupted records are skipped. */
+    while (1) {
+        size_t n = fread(stream->record, 1, stream->record_size, stream->file);
+        if (n < stream->record_size) {
+            if (n > 0) {
+                LOG(INFO, "ignoring truncated record at the end of stream");
+            }
+            return 0;
+        }
+        stream->k += 1;
+        if (bundle_decode(stream->record, stream->w_size, i, w) == 0) {
+            return 1;
+        }
+        LOG(WARN, "corrupted record %" PRIu64 " in stream", stream->k - 1);
+    }
+}
+
+extern void stream_close(struct stream* stream) {
+    fclose(stream->file);
+    free(stream->record);
+    free(stream->puzzle);
+    free(stream);
+}
+
+static void* writer_thread(void* argument) {
+    struct stream_writer* writer = argument;
+    mpz_t w;
+    mpz_init(w);
+
+    trace_thread("stream writer");
+    pthread_mutex_lock(&writer->mutex);
+    while (1) {
+        while (writer->n_queued == 0 && !writer->closing) {
+            pthread_cond_wait(&writer->cond, &writer->mutex);
+        }
+        if (writer->n_queued == 0) {
+            break;  // closing, and all records are written
+        }
+
+        // take ownership of the entry's value and release the queue
+        struct stream_entry* entry = &writer->queue[writer->head];
+        uint64_t i = entry->i;
+        mpz_swap(w, entry->w);
+        writer->head = (writer->head + 1) % STREAM_QUEUE_SIZE;
+        writer->n_queued -= 1;
+        pthread_mutex_unlock(&writer->mutex);
+
+        // flush every record: a crash loses at most the queued ones
+        trace_begin("stream_write");
+        if (bundle_encode(writer->record, writer->w_size, i, w) < 0 ||
+                fwrite(writer->record, writer->record_size, 1,
+                       writer->file) != 1 ||
+                fflush(writer->file) != 0) {
+            LOG(WARN, "failed to write stream (%s)", strerror(errno));
+        }
+        trace_end("stream_write");
+
+        pthread_mutex_lock(&writer->mutex);
+    }
+    pthread_mutex_unlock(&writer->mutex);
+
+    mpz_clear(w);
+    return NULL;
+}
+
+static FILE* open_append(const char* filename, size_t* w_size, const mpz_t n,
+                         const mpz_t c, uint64_t t) {
+    /* Open the stream for appending, creating it if needed; drop any partial
+     * record left by a crash, so that new records stay aligned */
+    size_t n_size, c_size;
+    unsigned char* puzzle = bundle_encode_puzzle(n, c, &n_size, &c_size);
+    if (puzzle == NULL) {
+        return NULL;
+    }
+    size_t puzzle_size = bundle_puzzle_size(n_size, c_size);
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        LOG(WARN, "failed to open %s (%s)", filename, strerror(errno));
+        free(puzzle);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        LOG(WARN, "failed to stat %s (%s)", filename, strerror(errno));
+        goto fail;
+    }
+
+    if (st.st_size == 0) {
+        unsigned char header[STREAM_HEADER_SIZE] = {0};
+        memcpy(header, STREAM_MAGIC, 8);
+        put_u32(header + 8, STREAM_VERSION);
+        put_u32(header + 12, (uint32_t) *w_size);
+        put_u64(header + 16, t);
+        put_u32(header + 24, (uint32_t) n_size);
+        put_u32(header + 28, (uint32_t) c_size);
+        put_u32(header + 32, crc32(crc32(0, header, 32), puzzle, puzzle_size));
+        if (write(fd, header, sizeof(header)) != (ssize_t) sizeof(header) ||
+                write(fd, puzzle, puzzle_size) != (ssize_t) puzzle_size) {
+            LOG(WARN, "failed to write stream (%s)", strerror(errno));
+            goto fail;
+        }
+    } else {
+        // keep the record size of the existing stream, which must be for the
+        // same puzzle
+        struct header header;
+        if (read_header(fd, filename, &header) < 0) {
+            goto fail;
+        }
+        int same = header.puzzle != NULL && header.t == t &&
+                   header.n_size == n_size && header.c_size == c_size &&
+                   memcmp(header.puzzle, puzzle, puzzle_size) == 0;
+        free(header.puzzle);
+        if (!same) {
+            LOG(WARN, "%s holds states of another puzzle", filename);
+            goto fail;
+        }
+        *w_size = header.w_size;
+
+        size_t record_size = bundle_record_size(*w_size);
+        size_t n_records = ((size_t) st.st_size - header.size) / record_size;
+        off_t length = (off_t) (header.size + n_records * record_size);
+        if (length != st.st_size && ftruncate(fd, length) < 0) {
+            LOG(WARN, "failed to truncate %s (%s)", filename, strerror(errno));
+            goto fail;
+        }
+    }
+    free(puzzle);
+
+    FILE* file = fdopen(fd, "ab");
+    if (file == NULL) {
+        LOG(WARN, "failed to open %s (%s)", filename, strerror(errno));
+        close(fd);
+    }
+    return file;
+
+fail:
+    free(puzzle);
+    close(fd);
+    return NULL;
+}
+
+extern struct stream_writer* stream_create(const char* filename,
+                                           size_t w_size, const mpz_t n,
+                                           const mpz_t c, uint64_t t) {
+    /* Open a stream of states of the puzzle with modulus n, control prime c
+     * and target t for appending, and start its writer thread */
+    struct stream_writer* writer = calloc(1, sizeof(*writer));
+    if (writer == NULL) {
+        return NULL;
+    }
+    writer->w_size = w_size;
+    writer->file = open_append(filename, &writer->w_size, n, c, t);
+    if (writer->file == NULL) {
+        free(writer);
+        return NULL;
+    }
+    writer->record_size = bundle_record_size(writer->w_size);
+    writer->record = malloc(writer->record_size);
+    if (writer->record == NULL) {
+        fclose(writer->file);
+        free(writer);
+        return NULL;
+    }
+    for (size_t k = 0; k < STREAM_QUEUE_SIZE; k += 1) {
+        mpz_init(writer->queue[k].w);
+    }
+
+    pthread_mutex_init(&writer->mutex, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+    // signals are for the thread doing the work; the new thread inherits
+    // the mask in place when it is created
+    sigset_t set, old_set;
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, &old_set);
+    int ret = pthread_create(&writer->thread, NULL, writer_thread, writer);
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+    if (ret != 0) {
+        LOG(WARN, "failed to start thread (%s)", strerror(ret));
+        pthread_cond_destroy(&writer->cond);
+        pthread_mutex_destroy(&writer->mutex);
+        for (size_t k = 0; k < STREAM_QUEUE_SIZE; k += 1) {
+            mpz_clear(writer->queue[k].w);
+        }
+        fclose(writer->file);
+        free(writer->record);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+extern int stream_append(struct stream_writer* writer, uint64_t i,
+                         const mpz_t w) {
+    /* Queue a record without waiting; return -1 if it had to be dropped */
+    trace_begin("stream lock");
+    pthread_mutex_lock(&writer->mutex);
+    trace_end("stream lock");
+    if (writer->n_queued == STREAM_QUEUE_SIZE) {
+        writer->n_dropped += 1;
+        pthread_mutex_unlock(&writer->mutex);
+        return -1;
+    }
+    size_t tail = (writer->head + writer->n_queued) % STREAM_QUEUE_SIZE;
+    writer->queue[tail].i = i;
+    mpz_set(writer->queue[tail].w, w);
+    writer->n_queued += 1;
+    pthread_cond_signal(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+    return 0;
+}
+
+extern int stream_finish(struct stream_writer* writer) {
+    /* Write the queued records, stop the writer thread and release it */
+    pthread_mutex_lock(&writer->mutex);
+    writer->closing = 1;
+    pthread_cond_signal(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+
+    int ret = 0;
+    int err = pthread_join(writer->thread, NULL);
+    if (err != 0) {
+        LOG(WARN, "failed to join thread (%s)", strerror(err));
+        ret = -1;
+    }
+    if (writer->n_dropped > 0) {
+        LOG(INFO, "%" PRIu64 " records were dropped from the stream",
+            writer->n_dropped);
+    }
+
+    if (fclose(writer->file) != 0) {
+        LOG(WARN, "failed to close stream (%s)", strerror(errno));
+        ret = -1;
+    }
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->mutex);
+    for (size_t k = 0; k < STREAM_QUEUE_SIZE; k += 1) {
+        mpz_clear(writer->queue[k].w);
+    }
+    free(writer->record);
+    free(writer);
+    return ret;
+}
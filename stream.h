@@ -0,0 +1,88 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+// external libraries
+#include <gmp.h>
+
+// POSIX
+#include <pthread.h>
+
+// C99
+#include <stdint.h>
+
+// C90
+#include <stdio.h>
+
+/* Checkpoint stream
+ *
+ * An append-only file where work logs the state after every block of
+ * squarings, so that validate can split the chain into many more intervals
+ * than the supervisor keeps. All integers are little-endian.
+ *
+ *   header   magic "LCS35LOG", version (u32), w_size (u32), t (u64),
+ *            n_size (u32), c_size (u32), CRC-32 of the previous fields
+ *            followed by the puzzle (u32), padding (u32)
+ *   puzzle   n and c of the puzzle, as in a bundle (see bundle.h)
+ *   records  bundle records (see bundle.h), in the order they were computed;
+ *            values of i may repeat or go back when work resumes from an
+ *            earlier checkpoint
+ *
+ * A record cut short by a crash is dropped when the stream is reopened.
+ * Version 1 streams have a 16-byte header with only magic, version and
+ * w_size, and no puzzle: they only hold states of LCS35 itself. */
+#define STREAM_MAGIC "LCS35LOG"
+#define STREAM_VERSION 2
+#define STREAM_HEADER_SIZE 40
+#define STREAM_V1_HEADER_SIZE 16
+// states waiting to be written; when full, new ones are dropped
+#define STREAM_QUEUE_SIZE 64
+
+struct stream_entry {
+    uint64_t i;
+    mpz_t w;
+};
+
+/* Records are written by a background thread, so that the thread computing
+ * never waits on the disk */
+struct stream_writer {
+    FILE* file;
+    size_t w_size;
+    size_t record_size;
+    unsigned char* record;  // buffer for one record
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct stream_entry queue[STREAM_QUEUE_SIZE];
+    size_t head;  // next entry to write
+    size_t n_queued;
+    int closing;
+    uint64_t n_dropped;
+};
+
+struct stream {
+    FILE* file;
+    size_t w_size;
+    size_t record_size;
+    unsigned char* record;
+    uint64_t k;  // position of the next record
+    unsigned char* puzzle;  // n and c; NULL for a version 1 stream
+    size_t n_size;
+    size_t c_size;
+    uint64_t t;
+};
+
+extern int stream_probe(const char* filename);
+extern struct stream* stream_open(const char* filename);
+extern int stream_parameters(const struct stream* stream, mpz_t n, mpz_t c,
+                             uint64_t* t);
+extern int stream_next(struct stream* stream, uint64_t* i, mpz_t w);
+extern void stream_close(struct stream* stream);
+
+extern struct stream_writer* stream_create(const char* filename,
+                                           size_t w_size, const mpz_t n,
+                                           const mpz_t c, uint64_t t);
+extern int stream_append(struct stream_writer* writer, uint64_t i,
+                         const mpz_t w);
+extern int stream_finish(struct stream_writer* writer);
+
+#endif
@@ -1,13 +1,85 @@
 #!/usr/bin/env python3
+import atexit
+import collections
+import contextlib
+import json
+import os
+import signal
 import sqlite3
 import socketserver
+import time
 
 # db is a global variable defined in main() pointing to an SQLite3 database
+# parameters is a global variable defined in main(): (n, c, t) for a test
+# puzzle, None for LCS35
+# trace is a global variable defined in main(): ring of (name, phase, ns)
+# events when --trace is given, None otherwise
+trace = None
+
+
+def w_to_blob(w):
+    # binary format of w in the checkpoint table (version 1)
+    return w.to_bytes((w.bit_length() + 7) // 8, 'little')
+
+
+def w_from_row(w, version):
+    # version 0 rows store w in decimal, version 1 rows in binary
+    if version == 1:
+        return int.from_bytes(w, 'little')
+    return int(w)
+
+
+def add_missing_columns(connection):
+    # databases from before these columns get them, so that the queries
+    # below also work on a database not yet converted by
+    # transitions/decimal-to-binary.py; rows added this way are version 0
+    columns = {row[1] for row in
+               connection.execute("PRAGMA table_info(checkpoint)")}
+    for name, declaration in (('version', 'INTEGER DEFAULT 0'),
+                              ('host', 'TEXT'), ('kernel', 'TEXT'),
+                              ('build', 'TEXT')):
+        if name not in columns:
+            connection.execute("ALTER TABLE checkpoint ADD COLUMN {} {}"
+                               .format(name, declaration))
+    connection.commit()
+
+
+def load_parameters():
+    # test puzzles created by the puzzle tool carry their own n, c and t
+    try:
+        row = db.execute("SELECT n, c, t FROM parameter LIMIT 1").fetchone()
+    except sqlite3.OperationalError:
+        return None
+    return row and (int(row[0]), int(row[1]), row[2])
+
+
+@contextlib.contextmanager
+def traced(name):
+    # begin/end events on the clock of trace.c (CLOCK_MONOTONIC), so that the
+    # timelines of work and supervisor line up in Perfetto
+    if trace is not None:
+        trace.append((name, 'B', time.monotonic_ns()))
+    try:
+        yield
+    finally:
+        if trace is not None:
+            trace.append((name, 'E', time.monotonic_ns()))
+
+
+def write_trace(filename):
+    # Chrome trace-event JSON, as written by trace.c
+    pid = os.getpid()
+    events = [{'name': 'thread_name', 'ph': 'M', 'pid': pid, 'tid': 1,
+               'args': {'name': 'supervisor'}}]
+    events += [{'name': name, 'ph': phase, 'ts': ns / 1000, 'pid': pid, 'tid': 1}
+               for name, phase, ns in trace]
+    with open(filename, 'w') as f:
+        json.dump({'traceEvents': events}, f)
 
 
 def check(i, w):
     # compute 2^(2^i) mod c quickly because c is prime, compare to w % c
-    c = 2446683847  # 32 bit prime
+    c = parameters[1] if parameters else 2446683847  # 32 bit prime
     return pow(2, pow(2, i, c-1), c) == w % c
 
 
@@ -17,20 +89,15 @@ class Supervisor(socketserver.TCPServer):
 
 class SupervisorHandler(socketserver.BaseRequestHandler):
     def handle(self):
-        data = self.request.recv(1024).strip().split(b':')
+        with traced('recv'):
+            data = self.receive().strip().split(b':')
         command = data[0]
         if command == b'resume':
-            cur = db.execute("SELECT i, w FROM checkpoint ORDER BY i DESC LIMIT 1")
-            i, w = cur.fetchone() or (0, 2)
-            w = int(w)
-            self.request.sendall(b"%#x:%i" % (i, w))
+            with traced('resume'):
+                self.resume()
         elif command == b'save':
-            i, w = int(data[1].decode(), 0), int(data[2].decode())
-            if not check(i, w):
-                print('invalid (i, w) = ({:#x}, {})'.format(i, w))
-            db.execute("INSERT INTO checkpoint (i, w) VALUES (?, ?)", (i, str(w)))
-            db.commit()
-            print('inserted (i, w) = ({:#x}, {})'.format(i, w))
+            with traced('save'):
+                self.save(data)
         elif command == b'mandate':
             # TODO
             pass
@@ -41,13 +108,59 @@ class SupervisorHandler(socketserver.BaseRequestHandler):
             print('Received invalid command {} from {}'
                   .format(command, self.client_address[0]))
 
+    def receive(self):
+        # a save frame is as long as w, which outgrows a single recv() with
+        # large test puzzles; workers close their side after a save, but wait
+        # for the answer after resume
+        data = b''
+        while not data.startswith(b'resume:'):
+            chunk = self.request.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+        return data
+
+    def resume(self):
+        with traced('sqlite'):
+            cur = db.execute("SELECT i, w, version FROM checkpoint ORDER BY i DESC LIMIT 1")
+            i, w, version = cur.fetchone() or (0, 2, 0)
+        w = w_from_row(w, version)
+        if parameters:
+            self.request.sendall(b"%#x:%i:%i:%i:%i" % ((i, w) + parameters))
+        else:
+            self.request.sendall(b"%#x:%i" % (i, w))
+
+    def save(self, data):
+        with traced('int'):
+            i, w = int(data[1].decode(), 0), int(data[2].decode())
+        # workers older than the kernel and build fields do not send them
+        kernel, build = (d.decode() for d in data[3:5]) if len(data) >= 5 else (None, None)
+        with traced('check'):
+            valid = check(i, w)
+        if not valid:
+            print('invalid (i, w) = ({:#x}, {})'.format(i, w))
+        with traced('sqlite'):
+            db.execute("INSERT INTO checkpoint (i, w, version, host, kernel, build) "
+                       "VALUES (?, ?, 1, ?, ?, ?)",
+                       (i, w_to_blob(w), self.client_address[0], kernel, build))
+            db.commit()
+        print('inserted (i, w) = ({:#x}, {}) from {} ({})'.format(i, w, kernel, build))
+
 
 def main(argv):
     # parse arguments
+    args = argv[1:]
+    if len(args) >= 2 and args[0] == '--trace':
+        global trace
+        trace = collections.deque(maxlen=1 << 16)  # as TRACE_RING_SIZE
+        atexit.register(write_trace, args[1])
+        # the trace is written on exit, which SIGTERM otherwise skips
+        signal.signal(signal.SIGTERM, lambda signum, frame: sys.exit(0))
+        args = args[2:]
     try:
-        filename = argv[1]
+        filename = args[0]
     except IndexError:
-        print('Usage: %s savefile.db', file=sys.stderr)
+        print('Usage: %s [--trace trace.json] savefile.db', file=sys.stderr)
         sys.exit(1)
 
     # open database
@@ -56,11 +169,19 @@ def main(argv):
     db.execute(
         "CREATE TABLE IF NOT EXISTS checkpoint ("
         "    i INTEGER UNIQUE,"
-        "    w TEXT,"
+        "    w BLOB,"
+        "    version INTEGER DEFAULT 0,"
         "    first_computed TIMESTAMP DEFAULT CURRENT_TIMESTAMP,"
-        "    last_computed TIMESTAMP DEFAULT CURRENT_TIMESTAMP"
+        "    last_computed TIMESTAMP DEFAULT CURRENT_TIMESTAMP,"
+        "    host TEXT,"
+        "    kernel TEXT,"
+        "    build TEXT"
         ")"
     )
+    add_missing_columns(db)
+
+    global parameters
+    parameters = load_parameters()
 
     # start server
     server = Supervisor(("", 4242), SupervisorHandler)
@@ -0,0 +1,154 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h" // source header
+
+// local includes
+#include "util.h"
+
+// POSIX
+#include <pthread.h>
+#include <unistd.h>
+
+// C99
+#include <inttypes.h>
+#include <stdint.h>
+
+// C90
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct trace_event {
+    const char* name;
+    uint64_t ns;
+    char phase;  // 'B' (begin) or 'E' (end)
+};
+
+struct trace_ring {
+    struct trace_event* events;
+    uint64_t count;  // events recorded, including the overwritten ones
+    char name[32];
+    unsigned tid;
+    struct trace_ring* next;
+};
+
+static const char* trace_filename;
+static int enabled;  // set once, before other threads are started
+static pthread_key_t key;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_ring* rings;
+static unsigned n_rings;
+
+static uint64_t now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+static struct trace_ring* get_ring(void) {
+    /* Ring buffer of the calling thread, created on first use */
+    struct trace_ring* ring = pthread_getspecific(key);
+    if (ring != NULL) {
+        return ring;
+    }
+    ring = calloc(1, sizeof(*ring));
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->events = malloc(TRACE_RING_SIZE * sizeof(*ring->events));
+    if (ring->events == NULL) {
+        free(ring);
+        return NULL;
+    }
+
+    // rings outlive their thread, so that joined workers are written too
+    pthread_mutex_lock(&lock);
+    n_rings += 1;
+    ring->tid = n_rings;
+    snprintf(ring->name, sizeof(ring->name), "thread %u", ring->tid);
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&lock);
+    pthread_setspecific(key, ring);
+    return ring;
+}
+
+static void record(const char* name, char phase) {
+    if (!enabled) {
+        return;
+    }
+    struct trace_ring* ring = get_ring();
+    if (ring == NULL) {
+        return;
+    }
+    struct trace_event* event = &ring->events[ring->count % TRACE_RING_SIZE];
+    event->name = name;
+    event->ns = now();
+    event->phase = phase;
+    ring->count += 1;
+}
+
+static void write_trace(void) {
+    /* Dump all rings as Chrome trace-event JSON */
+    FILE* f = fopen(trace_filename, "w");
+    if (f == NULL) {
+        LOG(WARN, "failed to open %s", trace_filename);
+        return;
+    }
+    long pid = (long) getpid();
+    const char* separator = "";
+    fprintf(f, "{\"traceEvents\":[\n");
+    pthread_mutex_lock(&lock);
+    for (struct trace_ring* ring = rings; ring != NULL; ring = ring->next) {
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,"
+                "\"tid\":%u,\"args\":{\"name\":\"%s\"}}", separator, pid,
+                ring->tid, ring->name);
+        separator = ",\n";
+        uint64_t first = ring->count > TRACE_RING_SIZE ?
+                         ring->count - TRACE_RING_SIZE : 0;
+        for (uint64_t k = first; k < ring->count; k += 1) {
+            const struct trace_event* event =
+                &ring->events[k % TRACE_RING_SIZE];
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRIu64
+                    ".%03" PRIu64 ",\"pid\":%ld,\"tid\":%u}", event->name,
+                    event->phase, event->ns / 1000, event->ns % 1000, pid,
+                    ring->tid);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    fprintf(f, "\n]}\n");
+    if (fclose(f) != 0) {
+        LOG(WARN, "failed to write %s", trace_filename);
+    }
+}
+
+extern int trace_start(const char* filename) {
+    /* Record events from now on, and write them to filename at exit */
+    if (pthread_key_create(&key, NULL) != 0 || atexit(write_trace) != 0) {
+        return -1;
+    }
+    trace_filename = filename;
+    enabled = 1;
+    trace_thread("main");
+    return 0;
+}
+
+extern void trace_thread(const char* name) {
+    /* Name the calling thread in the timeline */
+    if (!enabled) {
+        return;
+    }
+    struct trace_ring* ring = get_ring();
+    if (ring != NULL) {
+        snprintf(ring->name, sizeof(ring->name), "%s", name);
+    }
+}
+
+extern void trace_begin(const char* name) {
+    record(name, 'B');
+}
+
+extern void trace_end(const char* name) {
+    record(name, 'E');
+}
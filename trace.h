@@ -0,0 +1,20 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Timeline of begin/end events, written as Chrome trace-event JSON
+ *
+ * Tracing is off unless trace_start() is called, in which case trace_begin()
+ * and trace_end() only test a flag. Each thread records into its own ring
+ * buffer, without taking a lock, and only its last TRACE_RING_SIZE events are
+ * kept. Event names are stored as pointers, so they must be string literals.
+ * The file is written at exit; open it in Perfetto (ui.perfetto.dev) or in
+ * chrome://tracing. Timestamps come from CLOCK_MONOTONIC, which
+ * supervisor.py --trace uses as well, so that the timelines line up. */
+#define TRACE_RING_SIZE (1 << 16)
+
+extern int trace_start(const char* filename);
+extern void trace_thread(const char* name);
+extern void trace_begin(const char* name);
+extern void trace_end(const char* name);
+
+#endif
@@ -0,0 +1,33 @@
+#!/usr/bin/env python3
+import os
+import sqlite3
+import sys
+
+# same format and columns as the supervisor, which lives one level up
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                os.pardir))
+from supervisor import add_missing_columns, w_to_blob  # noqa: E402
+
+
+with sqlite3.connect('lcs35.db') as db:
+    add_missing_columns(db)
+
+    # convert by chunks to avoid loading the whole table in memory
+    last_i = -1
+    while True:
+        rows = db.execute(
+            '''SELECT i, w FROM checkpoint WHERE i > ? AND
+            (version = 0 OR version IS NULL) ORDER BY i LIMIT 10000''', (last_i,)
+        ).fetchall()
+        if not rows:
+            break
+        db.executemany(
+            'UPDATE checkpoint SET w = ?, version = 1 WHERE i = ?',
+            ((w_to_blob(int(w)), i) for i, w in rows)
+        )
+        last_i = rows[-1][0]
+
+# reclaim the space freed by the conversion
+db = sqlite3.connect('lcs35.db')
+db.execute('VACUUM')
+db.close()
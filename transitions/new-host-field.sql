@@ -0,0 +1 @@
+ALTER TABLE checkpoint ADD COLUMN host TEXT;
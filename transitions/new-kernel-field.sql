@@ -0,0 +1,2 @@
+ALTER TABLE checkpoint ADD COLUMN kernel TEXT;
+ALTER TABLE checkpoint ADD COLUMN build TEXT;
@@ -1,4 +1,12 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "checkpoints.h"
+#include "deque.h"
+#include "multi.h"
 #include "session.h"
+#include "store.h"
+#include "time.h"
+#include "trace.h"
 #include "util.h"
 
 // external libraries
@@ -6,150 +14,1021 @@
 
 // POSIX
 #include <pthread.h>
+#include <unistd.h>
 
 // C99
 #include <inttypes.h>
 
 // C90
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-struct checkpoints_queue {
-    pthread_mutex_t lock;
-    /* database handle */
-    sqlite3* db;
-    /* query for all checkpoints in increasing order of i */
-    sqlite3_stmt* stmt_checkkpoints;
-    /* values for i and w before the checkpoint returned by next call to
-     * sqlite3_step(stmt_checkkpoints) */
-    uint64_t last_i;
-    mpz_t last_w;
+// writes of a thread are committed together at the end of each interval, or
+// sooner when that many are pending
+#define STORE_BATCH_SIZE 64
+
+// squarings timed to estimate the cost of an interval in spot-check mode
+#define CALIBRATION_SQUARINGS (1ull << 16)
+
+// recorded in the validation table for intervals checked by batch mode
+#define BATCH_KERNEL "batch"
+
+struct validation {
+    /* path to the database; each worker opens its own connection; NULL when
+     * validating a bundle, in which case nothing is written back */
+    const char* filename;
+    /* all checkpoints, preloaded in increasing order of i; task k is the
+     * interval from checkpoint k-1 (or from i = 0) to checkpoint k */
+    struct checkpoints* checkpoints;
+    /* intervals recomputed together by each thread (multi.h); 1 to use
+     * session_work() */
+    size_t n_lanes;
+    /* one deque of tasks per thread */
+    size_t n_tasks;
+    size_t n_threads;
+    struct deque* deques;
+    /* outcome of each task: -1 if it was not run, otherwise whether the
+     * recomputed value matched; each entry is written by a single worker */
+    int* results;
 };
 
-static void* worker(void* argument) {
-    struct checkpoints_queue* queue = argument;
+struct worker_arguments {
+    struct validation* validation;
+    size_t id;
+};
 
-    /* session used to redo the computations */
+static struct session* new_session(const struct validation* validation) {
+    /* Session at i = 0 of the puzzle the checkpoints belong to, which
+     * bundles and streams record as well as databases */
     struct session* session = session_new();
-    mpz_t next_w;
-    mpz_init(next_w);
+    if (session == NULL) {
+        LOG(FATAL, "could not allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    const struct checkpoints* checkpoints = validation->checkpoints;
+    mpz_set(session->n, checkpoints->n);
+    mpz_set(session->c, checkpoints->c);
+    mpz_mul(session->n_times_c, session->n, session->c);
+    session->t = checkpoints->t;
+    return session;
+}
 
+static int steal_task(struct validation* validation, size_t id,
+                      size_t* task) {
+    /* Steal a task from another thread; returns 0 once all deques are empty */
     while (1) {
-        pthread_mutex_lock(&queue->lock);
-        if (sqlite3_step(queue->stmt_checkkpoints) != SQLITE_ROW) {
-            pthread_mutex_unlock(&queue->lock);
-            break;
+        int aborted = 0;
+        for (size_t k = 1; k < validation->n_threads; k += 1) {
+            size_t victim = (id + k) % validation->n_threads;
+            enum deque_status status =
+                deque_steal(&validation->deques[victim], task);
+            if (status == DEQUE_TASK) {
+                return 1;
+            } else if (status == DEQUE_ABORT) {
+                aborted = 1;
+            }
+        }
+        // no task is added once the threads are started
+        if (!aborted) {
+            return 0;
         }
+    }
+}
 
-        uint64_t next_i = (uint64_t) sqlite3_column_int64(queue->stmt_checkkpoints, 0);
-        const char* str_w = (const char*) sqlite3_column_text(queue->stmt_checkkpoints, 1);
-        if (mpz_set_str(next_w, str_w, 10) < 0) {
-            LOG(FATAL, "invalid decimal number w = %s", str_w);
-            pthread_mutex_unlock(&queue->lock);
-            exit(EXIT_FAILURE);
+static int next_task(struct validation* validation, size_t id, size_t* task) {
+    /* Take a task from our own deque, or steal one from another thread */
+    if (deque_pop(&validation->deques[id], task) == DEQUE_TASK) {
+        return 1;
+    }
+    trace_begin("steal");
+    int ret = steal_task(validation, id, task);
+    trace_end("steal");
+    return ret;
+}
+
+static uint64_t work_block(struct session* session, struct multi* multi) {
+    /* session_work() on a block of 2**20 squarings, as a trace event
+     *
+     * When multi is not NULL, its lane 0 does the squarings instead */
+    if (multi == NULL) {
+        trace_begin("session_work");
+        uint64_t amount = session_work(session, 1ull<<20);
+        trace_end("session_work");
+        return amount;
+    }
+    uint64_t amount = session->t - session->i;
+    if (amount > 1ull<<20) {
+        amount = 1ull<<20;
+    }
+    if (amount == 0) {
+        return 0;
+    }
+    trace_begin("multi_work");
+    multi_set(multi, 0, session->w);
+    multi_work(multi, amount);
+    multi_get(multi, 0, session->w);
+    trace_end("multi_work");
+    session->i += amount;
+    return amount;
+}
+
+static uint64_t task_from(const struct checkpoints* checkpoints, size_t k) {
+    /* Start of the interval of task k */
+    return k == 0 ? 0 : checkpoints->items[k-1].i;
+}
+
+static int validate_interval(struct session* session, struct multi* multi,
+                             struct store* store,
+                             uint64_t last_i, const mpz_t last_w,
+                             uint64_t next_i, const mpz_t next_w) {
+    /* Recompute w at next_i from w at last_i, with work_block() */
+    const char* kernel = multi == NULL ? SESSION_KERNEL : multi->kernel;
+    session->i = last_i;
+    mpz_set(session->w, last_w);
+
+    // work from previous checkpoint; make new ones every regularly
+    uint64_t sub_i = last_i;  // last sub-checkpoint
+    session->t = ((session->i >> 25) + 1) << 25;  // next multiple of 2**25
+    while (session->t < next_i) {
+
+        while (work_block(session, multi)) {
+            double progress = (double) (session->i - last_i) / (double) (next_i - last_i);
+            printf("%#.12" PRIx64 " -> %#.12" PRIx64 ": %5.1f%%\n",
+                   last_i, next_i, 100*progress);
         }
+        // persist progress: a later run resumes from this sub-checkpoint,
+        // which is only trusted once the end of the interval matches
+        if (store != NULL) {
+            store_write(store, STORE_INSERT, session->i, session->w, kernel);
+            store_validation(store, sub_i, session->i, kernel,
+                             STORE_PENDING);
+            if (store_flush(store) < 0) {
+                LOG(ERR, "failed to save progress at %#.12" PRIx64,
+                    session->i);
+            }
+        }
+        sub_i = session->i;
+        session->t += 1 << 25;
+    }
 
-        // use last parameters from queue for session
-        uint64_t last_i = queue->last_i;  // save it to compute progress
-        session->i = last_i;
-        mpz_set(session->w, queue->last_w);
+    // complete checking up to next checkpoint
+    session->t = next_i;
+    while (work_block(session, multi)) {
+        double progress = (double) (session->i - last_i) / (double) (next_i - last_i);
+        printf("%#.12" PRIx64 " -> %#.12" PRIx64 ": %5.1f%%\n",
+               last_i, next_i, 100*progress);
+    }
+    // only confirmed checkpoints are marked as recomputed; compact
+    // relies on this to know which history it may thin out; the result also
+    // settles the sub-checkpoints of the interval
+    int valid = mpz_cmp(session->w, next_w) == 0;
+    if (!valid) {
+        LOG(ERR, "INVALID %#.12" PRIx64 " -> %#.12" PRIx64, last_i,
+            session->i);
+    } else if (store != NULL) {
+        session_checkpoint_update(session, store);
+    }
+    if (store != NULL) {
+        store_validation(store, sub_i, next_i, kernel, valid);
+    }
 
-        // before releasing the lock, update queue information
-        queue->last_i = next_i;
-        mpz_set(queue->last_w, next_w);
+    // commit the writes of the interval together
+    if (store != NULL && store_flush(store) < 0) {
+        LOG(ERR, "failed to save results up to %#.12" PRIx64, next_i);
+    }
+    return valid;
+}
 
-        pthread_mutex_unlock(&queue->lock);
+static int validate_task(const struct validation* validation,
+                         struct session* session, struct multi* multi,
+                         struct store* store, size_t k) {
+    /* validate_interval() on the interval of task k */
+    const struct checkpoint* items = validation->checkpoints->items;
+    if (k > 0) {
+        return validate_interval(session, multi, store, items[k-1].i,
+                                 items[k-1].w, items[k].i, items[k].w);
+    }
+    mpz_t first_w;
+    mpz_init_set_ui(first_w, 2);
+    int valid = validate_interval(session, multi, store, 0, first_w,
+                                  items[k].i, items[k].w);
+    mpz_clear(first_w);
+    return valid;
+}
 
-#define MIN(a, b) ((a) < (b) ? (a) : (b))
+struct lane {
+    size_t k;  // task
+    uint64_t i;  // current exponent
+    uint64_t sub_i;  // last sub-checkpoint
+};
 
-        // work from previous checkpoint; make new ones every regularly
-        session->t = ((session->i >> 25) + 1) << 25;  // next multiple of 2**25
-        while (session->t < next_i) {
+static void validate_lanes(struct validation* validation, size_t id,
+                           struct multi* multi, struct session* session,
+                           struct store* store) {
+    /* Same as validate_interval(), with several tasks in lock-step
+     *
+     * A lane whose interval is complete takes the next task while the others
+     * go on. Tasks whose checkpoint was computed by the kernel of multi are
+     * set aside and recomputed by session_work() once the lanes are drained,
+     * so that they do not hold the other lanes up for a whole interval. */
+    const struct checkpoint* items = validation->checkpoints->items;
+    struct lane lanes[MULTI_MAX_LANES];
+    int active[MULTI_MAX_LANES] = {0};
+    size_t n_active = 0;
+    size_t* deferred = malloc(validation->checkpoints->count *
+                              sizeof(*deferred));
+    size_t n_deferred = 0;
+    if (deferred == NULL) {
+        LOG(FATAL, "could not allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    mpz_t w;
+    mpz_init(w);
+    while (1) {
+        for (size_t l = 0; l < multi->n_lanes; l += 1) {
+            if (active[l]) {
+                continue;
+            }
+            size_t k;
+            int found = 0;
+            while (next_task(validation, id, &k)) {
+                if (!checkpoints_same_kernel(validation->checkpoints, k,
+                                             multi->kernel)) {
+                    found = 1;
+                    break;
+                }
+                deferred[n_deferred] = k;
+                n_deferred += 1;
+            }
+            if (!found) {
+                continue;
+            }
+            lanes[l].k = k;
+            lanes[l].i = task_from(validation->checkpoints, k);
+            lanes[l].sub_i = lanes[l].i;
+            if (k == 0) {
+                mpz_set_ui(w, 2);
+                multi_set(multi, l, w);
+            } else {
+                multi_set(multi, l, items[k-1].w);
+            }
+            active[l] = 1;
+            n_active += 1;
+        }
+        if (n_active == 0) {
+            break;
+        }
 
-            while (session_work(session, 1ull<<20)) {
-                double progress = (double) (session->i - last_i) / (double) (next_i - last_i);
-                printf("%#.12" PRIx64 " -> %#.12" PRIx64 ": %5.1f%%\n",
-                       last_i, next_i, 100*progress);
+        // stop when a lane completes its interval or a multiple of 2**25
+        uint64_t amount = 1ull << 20;
+        for (size_t l = 0; l < multi->n_lanes; l += 1) {
+            if (!active[l]) {
+                continue;
+            }
+            uint64_t next_i = items[lanes[l].k].i;
+            uint64_t sub_t = ((lanes[l].i >> 25) + 1) << 25;
+            uint64_t stop = sub_t < next_i ? sub_t : next_i;
+            if (stop - lanes[l].i < amount) {
+                amount = stop - lanes[l].i;
             }
-            session_checkpoint_insert(session, queue->db);
-            session->t += 1 << 25;
         }
+        trace_begin("multi_work");
+        multi_work(multi, amount);
+        trace_end("multi_work");
 
-        // complete checking up to next checkpoint
-        session->t = next_i;
-        while (session_work(session, 1ull<<20)) {
-            double progress = (double) (session->i - last_i) / (double) (next_i - last_i);
+        for (size_t l = 0; l < multi->n_lanes; l += 1) {
+            if (!active[l]) {
+                continue;
+            }
+            struct lane* lane = &lanes[l];
+            uint64_t last_i = task_from(validation->checkpoints, lane->k);
+            uint64_t next_i = items[lane->k].i;
+            lane->i += amount;
+            double progress = (double) (lane->i - last_i) /
+                              (double) (next_i - last_i);
             printf("%#.12" PRIx64 " -> %#.12" PRIx64 ": %5.1f%%\n",
                    last_i, next_i, 100*progress);
+
+            if (lane->i == next_i) {
+                multi_get(multi, l, w);
+                int valid = mpz_cmp(w, items[lane->k].w) == 0;
+                if (!valid) {
+                    LOG(ERR, "INVALID %#.12" PRIx64 " -> %#.12" PRIx64,
+                        last_i, next_i);
+                } else if (store != NULL) {
+                    store_write(store, STORE_UPDATE, next_i, w, NULL);
+                }
+                if (store != NULL) {
+                    store_validation(store, lane->sub_i, next_i,
+                                     multi->kernel, valid);
+                    if (store_flush(store) < 0) {
+                        LOG(ERR, "failed to save results up to %#.12" PRIx64,
+                            next_i);
+                    }
+                }
+                validation->results[lane->k] = valid;
+                active[l] = 0;
+                n_active -= 1;
+            } else if (lane->i % (1ull << 25) == 0) {
+                // persist progress: a later run resumes from this
+                // sub-checkpoint, trusted once the end of the interval matches
+                if (store != NULL) {
+                    multi_get(multi, l, w);
+                    store_write(store, STORE_INSERT, lane->i, w,
+                                multi->kernel);
+                    store_validation(store, lane->sub_i, lane->i,
+                                     multi->kernel, STORE_PENDING);
+                    if (store_flush(store) < 0) {
+                        LOG(ERR, "failed to save progress at %#.12" PRIx64,
+                            lane->i);
+                    }
+                }
+                lane->sub_i = lane->i;
+            }
         }
-        session_checkpoint_update(session, queue->db);
+    }
+    mpz_clear(w);
+
+    for (size_t j = 0; j < n_deferred; j += 1) {
+        validation->results[deferred[j]] =
+            validate_task(validation, session, NULL, store, deferred[j]);
+    }
+    free(deferred);
+}
 
-        if (mpz_cmp(session->w, next_w) != 0) {
-            LOG(ERR, "INVALID %#.12" PRIx64 " -> %#.12" PRIx64, last_i,
-                session->i);
+static void* worker(void* argument) {
+    struct worker_arguments* arguments = argument;
+    struct validation* validation = arguments->validation;
+    trace_thread("worker");
+
+    /* connection of this thread, so that writes are not serialized with
+     * the other threads' */
+    struct store* store = NULL;
+    if (validation->filename != NULL) {
+        store = store_open_existing(validation->filename,
+                                    STORE_BATCH_SIZE);
+        if (store == NULL) {
+            LOG(FATAL, "failed to open %s", validation->filename);
+            exit(EXIT_FAILURE);
         }
     }
 
+    /* session used to redo the computations */
+    struct session* session = new_session(validation);
+    /* with a single lane, multi only recomputes the intervals computed by
+     * session_work() in the first place */
+    struct multi* multi = multi_new(session->n_times_c, validation->n_lanes);
+    if (multi == NULL) {
+        LOG(FATAL, "could not allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    if (validation->n_lanes > 1) {
+        validate_lanes(validation, arguments->id, multi, session, store);
+    } else {
+        size_t k;
+        while (next_task(validation, arguments->id, &k)) {
+            int same = checkpoints_same_kernel(validation->checkpoints, k,
+                                               SESSION_KERNEL);
+            validation->results[k] = validate_task(
+                validation, session, same ? multi : NULL, store, k);
+        }
+    }
+
+    multi_delete(multi);
     session_delete(session);
+    if (store != NULL && store_close(store) < 0) {
+        LOG(ERR, "failed to save results");
+    }
     return NULL;
 }
 
+struct task_length {
+    size_t k;
+    uint64_t length;
+    double key;  // spot-check mode: random sort key
+};
+
+static int compare_task_length(const void* a, const void* b) {
+    // decreasing order of length
+    uint64_t la = ((const struct task_length*) a)->length;
+    uint64_t lb = ((const struct task_length*) b)->length;
+    return (la < lb) - (la > lb);
+}
+
+static int compare_task_key(const void* a, const void* b) {
+    // decreasing order of key
+    double ka = ((const struct task_length*) a)->key;
+    double kb = ((const struct task_length*) b)->key;
+    return (ka < kb) - (ka > kb);
+}
+
+static size_t collect_tasks(const struct validation* validation,
+                            struct task_length* tasks) {
+    /* List the tasks that are neither validated by a previous run nor already
+     * run by this one
+     *
+     * A task that an interrupted run recomputed up to a sub-checkpoint is left
+     * out when the task that continues from there is listed: its result is
+     * then given to the whole chain (see store_validation()). */
+    const struct checkpoints* checkpoints = validation->checkpoints;
+    size_t n_tasks = 0;
+    int continued = 0;  // whether the next task is listed or left out
+    for (size_t k = checkpoints->count; k-- > 0;) {
+        uint64_t last_i = task_from(checkpoints, k);
+        uint64_t next_i = checkpoints->items[k].i;
+        if (validation->results[k] >= 0 ||
+                checkpoints_validated(checkpoints, last_i, next_i)) {
+            continued = 0;
+            continue;
+        }
+        if (continued && checkpoints_pending(checkpoints, last_i, next_i)) {
+            continue;
+        }
+        tasks[n_tasks].k = k;
+        tasks[n_tasks].length = next_i - last_i;
+        tasks[n_tasks].key = 0;
+        n_tasks += 1;
+        continued = 1;
+    }
+
+    // by increasing k
+    for (size_t j = 0; j < n_tasks / 2; j += 1) {
+        struct task_length task = tasks[j];
+        tasks[j] = tasks[n_tasks - 1 - j];
+        tasks[n_tasks - 1 - j] = task;
+    }
+    return n_tasks;
+}
+
+static int schedule(struct validation* validation, struct task_length* tasks,
+                    size_t n_tasks) {
+    /* Deal tasks to the threads' deques, longest first */
+    validation->n_tasks = n_tasks;
+    qsort(tasks, n_tasks, sizeof(*tasks), compare_task_length);
+
+    size_t n_threads = validation->n_threads;
+    size_t capacity = n_tasks / n_threads + 1;
+    for (size_t t = 0; t < n_threads; t += 1) {
+        if (deque_init(&validation->deques[t], capacity) < 0) {
+            return -1;
+        }
+    }
+
+    // owners pop the most recently pushed task, so push shortest first
+    for (size_t j = n_tasks; j-- > 0;) {
+        deque_push(&validation->deques[j % n_threads], tasks[j].k);
+    }
+    return 0;
+}
+
+static void run(struct validation* validation) {
+    /* Work through the scheduled tasks with all threads */
+    pthread_t* threads = malloc(validation->n_threads * sizeof(*threads));
+    struct worker_arguments* arguments =
+        malloc(validation->n_threads * sizeof(*arguments));
+    if (threads == NULL || arguments == NULL) {
+        LOG(FATAL, "could not allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < validation->n_threads; i += 1) {
+        arguments[i].validation = validation;
+        arguments[i].id = i;
+        int ret = pthread_create(&threads[i], NULL, worker, &arguments[i]);
+        if (ret != 0) {
+            LOG(FATAL, "failed to start thread (%s)", strerror(ret));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (size_t i = 0; i < validation->n_threads; i += 1) {
+        int ret = pthread_join(threads[i], NULL);
+        if (ret != 0) {
+            LOG(ERR, "failed to join thread (%s)", strerror(ret));
+        }
+    }
+
+    free(arguments);
+    free(threads);
+    for (size_t i = 0; i < validation->n_threads; i += 1) {
+        deque_destroy(&validation->deques[i]);
+    }
+}
+
+static uint64_t next_random(uint64_t* state) {
+    /* splitmix64 */
+    *state += 0x9e3779b97f4a7c15;
+    uint64_t z = *state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+static double squaring_rate(const struct validation* validation) {
+    /* Estimate how many squarings a thread performs per second, modulo n*c
+     * of the puzzle being validated */
+    struct session* session = new_session(validation);
+    size_t n_lanes = validation->n_lanes;
+    double start = real_clock();
+    if (n_lanes > 1) {
+        struct multi* multi = multi_new(session->n_times_c, n_lanes);
+        if (multi == NULL) {
+            LOG(FATAL, "could not allocate memory");
+            exit(EXIT_FAILURE);
+        }
+        multi_work(multi, CALIBRATION_SQUARINGS / n_lanes);
+        multi_delete(multi);
+    } else {
+        session->t = CALIBRATION_SQUARINGS;
+        while (session_work(session, CALIBRATION_SQUARINGS)) {
+        }
+    }
+    double elapsed = real_clock() - start;
+    session_delete(session);
+    return (double) CALIBRATION_SQUARINGS / elapsed;
+}
+
+struct host_report {
+    size_t n_validated;  // intervals validated by previous runs
+    size_t n_intervals;  // intervals produced by the host
+    uint64_t squarings;  // squarings in these intervals
+    size_t n_checked;  // intervals checked by this run
+    uint64_t squarings_checked;
+    size_t n_failed;
+};
+
+static const char* host_name(const struct checkpoints* checkpoints,
+                             size_t h) {
+    /* Hosts are indexed from 1, 0 is for checkpoints of unknown origin */
+    return h == 0 ? "(unknown)" : checkpoints->hosts[h-1];
+}
+
+static void report_hosts(const struct validation* validation,
+                         struct host_report* reports) {
+    /* Tally results per host and print the confidence they give */
+    const struct checkpoints* checkpoints = validation->checkpoints;
+    for (size_t h = 0; h <= checkpoints->n_hosts; h += 1) {
+        reports[h].n_checked = 0;
+        reports[h].squarings_checked = 0;
+        reports[h].n_failed = 0;
+    }
+    for (size_t k = 0; k < checkpoints->count; k += 1) {
+        if (validation->results[k] < 0) {
+            continue;
+        }
+        struct host_report* report =
+            &reports[checkpoints->items[k].host + 1];
+        report->n_checked += 1;
+        report->squarings_checked +=
+            checkpoints->items[k].i - task_from(checkpoints, k);
+        report->n_failed += validation->results[k] == 0;
+    }
+
+    for (size_t h = 0; h <= checkpoints->n_hosts; h += 1) {
+        const struct host_report* report = &reports[h];
+        if (report->n_intervals == 0) {
+            continue;
+        }
+        double coverage = report->squarings == 0 ? 1 :
+            (double) report->squarings_checked / (double) report->squarings;
+        printf("%s: checked %zu/%zu intervals (%.3f%% of squarings)",
+               host_name(checkpoints, h), report->n_checked,
+               report->n_intervals - report->n_validated, 100 * coverage);
+        if (report->n_failed > 0) {
+            printf(", %zu FAILED\n", report->n_failed);
+        } else if (report->n_checked > 0) {
+            /* within a host, draws are proportional to length: if a fraction
+             * f of its squarings lie in corrupted intervals, k clean draws
+             * happen with probability at most (1-f)^k, which is below 5% as
+             * soon as f > 1 - 0.05^(1/k) (roughly: intervals that do not fit
+             * in the budget are passed over) */
+            double bound = 1 - pow(0.05, 1 / (double) report->n_checked);
+            printf(", corrupted fraction < %.3f%% (95%% confidence)\n",
+                   100 * bound);
+        } else {
+            printf("\n");
+        }
+    }
+}
+
+static int spot_check(struct validation* validation, double budget,
+                      uint64_t seed) {
+    /* Recompute a random sample of the intervals that fits in budget seconds
+     * of CPU time, then all intervals of the hosts caught producing a wrong
+     * result
+     *
+     * Intervals are drawn without replacement with probability proportional
+     * to their length, so that each squaring has the same chance of being
+     * checked, and to a host weight that decreases with how much of the host's
+     * work was already validated, so that new workers are checked first. */
+    const struct checkpoints* checkpoints = validation->checkpoints;
+    size_t n_hosts = checkpoints->n_hosts + 1;
+    struct host_report* reports = calloc(n_hosts, sizeof(*reports));
+    struct task_length* tasks = malloc(checkpoints->count * sizeof(*tasks));
+    if (reports == NULL || (checkpoints->count > 0 && tasks == NULL)) {
+        free(reports);
+        return -1;
+    }
+    for (size_t k = 0; k < checkpoints->count; k += 1) {
+        uint64_t last_i = task_from(checkpoints, k);
+        struct host_report* report = &reports[checkpoints->items[k].host + 1];
+        report->n_intervals += 1;
+        report->squarings += checkpoints->items[k].i - last_i;
+        if (checkpoints_validated(checkpoints, last_i,
+                                  checkpoints->items[k].i)) {
+            report->n_validated += 1;
+        }
+    }
+
+    // weighted sampling without replacement (Efraimidis-Spirakis): sort by
+    // u^(1/weight) for u uniform in (0, 1], take from the largest key
+    size_t n_tasks = collect_tasks(validation, tasks);
+    for (size_t j = 0; j < n_tasks; j += 1) {
+        const struct host_report* report =
+            &reports[checkpoints->items[tasks[j].k].host + 1];
+        double weight = (double) tasks[j].length /
+                        sqrt(1 + (double) report->n_validated);
+        double u = (double) ((next_random(&seed) >> 11) + 1) / 0x1p53;
+        tasks[j].key = log(u) / weight;
+    }
+    qsort(tasks, n_tasks, sizeof(*tasks), compare_task_key);
+
+    double rate = squaring_rate(validation);
+    double cost = 0;
+    size_t n_selected = 0;
+    for (size_t j = 0; j < n_tasks; j += 1) {
+        double task_cost = (double) tasks[j].length / rate;
+        if (cost + task_cost > budget) {
+            continue;
+        }
+        cost += task_cost;
+        tasks[n_selected] = tasks[j];
+        n_selected += 1;
+    }
+
+    printf("Spot-checking %zu of %zu intervals (about %.1f CPU seconds at "
+           "%.0f squarings/s) with %zu threads...\n", n_selected, n_tasks,
+           cost, rate, validation->n_threads);
+    if (schedule(validation, tasks, n_selected) < 0) {
+        free(tasks);
+        free(reports);
+        return -1;
+    }
+    run(validation);
+    report_hosts(validation, reports);
+
+    // escalate: a host that got one interval wrong may have got others
+    n_tasks = collect_tasks(validation, tasks);
+    n_selected = 0;
+    for (size_t j = 0; j < n_tasks; j += 1) {
+        if (reports[checkpoints->items[tasks[j].k].host + 1].n_failed > 0) {
+            tasks[n_selected] = tasks[j];
+            n_selected += 1;
+        }
+    }
+    if (n_selected > 0) {
+        printf("Validating the %zu remaining intervals of failed hosts...\n",
+               n_selected);
+        if (schedule(validation, tasks, n_selected) < 0) {
+            free(tasks);
+            free(reports);
+            return -1;
+        }
+        run(validation);
+        report_hosts(validation, reports);
+    }
+
+    free(tasks);
+    free(reports);
+    return 0;
+}
+
+static void combine(mpz_t x, mpz_t y, const struct checkpoints* checkpoints,
+                    const struct task_length* tasks, const mpz_t* r,
+                    size_t n, unsigned lambda, const mpz_t first_w,
+                    const mpz_t modulus) {
+    /* x = prod(from_w^r), y = prod(to_w^r) over the n tasks
+     *
+     * Straus' interleaving: the squarings are shared by all the terms, so the
+     * cost is lambda squarings plus about lambda/2 multiplications per term */
+    mpz_set_ui(x, 1);
+    mpz_set_ui(y, 1);
+    for (unsigned bit = lambda; bit-- > 0;) {
+        mpz_mul(x, x, x);
+        mpz_mod(x, x, modulus);
+        mpz_mul(y, y, y);
+        mpz_mod(y, y, modulus);
+        for (size_t j = 0; j < n; j += 1) {
+            if (!mpz_tstbit(r[j], bit)) {
+                continue;
+            }
+            size_t k = tasks[j].k;
+            mpz_mul(x, x, k == 0 ? first_w : checkpoints->items[k-1].w);
+            mpz_mod(x, x, modulus);
+            mpz_mul(y, y, checkpoints->items[k].w);
+            mpz_mod(y, y, modulus);
+        }
+    }
+}
+
+struct batch {
+    struct validation* validation;
+    struct session* session;
+    struct multi* multi;  // single lane, for work of session_work()
+    struct store* store;  // NULL when validating a bundle
+    gmp_randstate_t state;
+    unsigned lambda;
+    mpz_t first_w;
+    size_t n_chains;  // squaring chains run so far
+};
+
+static void batch_check(struct batch* batch, const struct task_length* tasks,
+                        size_t n) {
+    /* Validate n intervals of the same length with a single squaring chain
+     *
+     * If w_to = w_from^(2^length) for every interval, then for any exponents
+     * r, prod(w_from^r)^(2^length) = prod(w_to^r). When some interval is
+     * wrong, random lambda-bit exponents make the check pass with probability
+     * about 2^-lambda (faults would need to land on elements of small order
+     * to do better). A failed check is bisected down to single intervals,
+     * which are recomputed directly to find out which ones are wrong. */
+    const struct checkpoints* checkpoints = batch->validation->checkpoints;
+    // the chain must not be run by a kernel that computed one of the terms
+    struct multi* multi = NULL;
+    for (size_t j = 0; j < n; j += 1) {
+        if (checkpoints_same_kernel(checkpoints, tasks[j].k, SESSION_KERNEL)) {
+            multi = batch->multi;
+        }
+    }
+    if (n == 1) {
+        batch->validation->results[tasks[0].k] = validate_task(
+            batch->validation, batch->session, multi, batch->store,
+            tasks[0].k);
+        batch->n_chains += 1;
+        return;
+    }
+
+    mpz_t* r = malloc(n * sizeof(*r));
+    if (r == NULL) {
+        LOG(FATAL, "could not allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t j = 0; j < n; j += 1) {
+        mpz_init(r[j]);
+        mpz_urandomb(r[j], batch->state, batch->lambda);
+    }
+    mpz_t x, y;
+    mpz_init(x);
+    mpz_init(y);
+    struct session* session = batch->session;
+    trace_begin("combine");
+    combine(x, y, checkpoints, tasks, (const mpz_t*) r, n, batch->lambda,
+            batch->first_w, session->n_times_c);
+    trace_end("combine");
+    for (size_t j = 0; j < n; j += 1) {
+        mpz_clear(r[j]);
+    }
+    free(r);
+
+    printf("Checking %zu intervals of %#" PRIx64 " squarings together...\n",
+           n, tasks[0].length);
+    session->i = 0;
+    session->t = tasks[0].length;
+    mpz_set(session->w, x);
+    while (work_block(session, multi)) {
+    }
+    batch->n_chains += 1;
+    int valid = mpz_cmp(session->w, y) == 0;
+    mpz_clear(y);
+    mpz_clear(x);
+
+    if (!valid) {
+        LOG(WARN, "batch check failed, bisecting");
+        batch_check(batch, tasks, n / 2);
+        batch_check(batch, tasks + n / 2, n - n / 2);
+        return;
+    }
+
+    for (size_t j = 0; j < n; j += 1) {
+        size_t k = tasks[j].k;
+        batch->validation->results[k] = 1;
+        if (batch->store != NULL) {
+            store_write(batch->store, STORE_UPDATE, checkpoints->items[k].i,
+                        checkpoints->items[k].w, NULL);
+            store_validation(batch->store, task_from(checkpoints, k),
+                             checkpoints->items[k].i, BATCH_KERNEL, 1);
+        }
+    }
+    if (batch->store != NULL && store_flush(batch->store) < 0) {
+        LOG(ERR, "failed to save results of the batch");
+    }
+}
+
+static int validate_batches(struct validation* validation, unsigned lambda,
+                            uint64_t seed) {
+    /* Recompute all intervals not validated by a previous run, checking
+     * intervals of the same length together */
+    const struct checkpoints* checkpoints = validation->checkpoints;
+    struct task_length* tasks = malloc(checkpoints->count * sizeof(*tasks));
+    if (checkpoints->count > 0 && tasks == NULL) {
+        return -1;
+    }
+    size_t n_tasks = collect_tasks(validation, tasks);
+    qsort(tasks, n_tasks, sizeof(*tasks), compare_task_length);
+
+    struct batch batch = {
+        .validation = validation,
+        .session = new_session(validation),
+        .lambda = lambda,
+    };
+    if (validation->filename != NULL) {
+        batch.store = store_open_existing(validation->filename,
+                                          STORE_BATCH_SIZE);
+        if (batch.store == NULL) {
+            LOG(FATAL, "failed to open %s", validation->filename);
+            exit(EXIT_FAILURE);
+        }
+    }
+    batch.multi = multi_new(batch.session->n_times_c, 1);
+    if (batch.multi == NULL) {
+        LOG(FATAL, "could not allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    gmp_randinit_default(batch.state);
+    gmp_randseed_ui(batch.state, (unsigned long) seed);
+    mpz_init_set_ui(batch.first_w, 2);
+
+    printf("Working on %zu intervals (%zu already validated) in batches...\n",
+           n_tasks, checkpoints->count - n_tasks);
+    size_t start = 0;
+    for (size_t j = 1; j <= n_tasks; j += 1) {
+        if (j == n_tasks || tasks[j].length != tasks[start].length) {
+            batch_check(&batch, tasks + start, j - start);
+            start = j;
+        }
+    }
+
+    size_t n_invalid = 0;
+    for (size_t j = 0; j < n_tasks; j += 1) {
+        n_invalid += validation->results[tasks[j].k] == 0;
+    }
+    printf("%zu intervals checked with %zu squaring chains, %zu INVALID\n",
+           n_tasks, batch.n_chains, n_invalid);
+
+    mpz_clear(batch.first_w);
+    gmp_randclear(batch.state);
+    multi_delete(batch.multi);
+    session_delete(batch.session);
+    free(tasks);
+    if (batch.store != NULL && store_close(batch.store) < 0) {
+        LOG(ERR, "failed to save results");
+    }
+    return 0;
+}
+
+static int validate_all(struct validation* validation) {
+    /* Recompute all intervals not validated by a previous run */
+    const struct checkpoints* checkpoints = validation->checkpoints;
+    struct task_length* tasks = malloc(checkpoints->count * sizeof(*tasks));
+    if (checkpoints->count > 0 && tasks == NULL) {
+        return -1;
+    }
+    size_t n_tasks = collect_tasks(validation, tasks);
+    int ret = schedule(validation, tasks, n_tasks);
+    free(tasks);
+    if (ret < 0) {
+        return -1;
+    }
+
+    printf("Working on %zu intervals (%zu already validated) with %zu "
+           "threads of %zu lanes...\n", validation->n_tasks,
+           checkpoints->count - validation->n_tasks, validation->n_threads,
+           validation->n_lanes);
+    run(validation);
+    return 0;
+}
+
 extern int main(int argc, char** argv) {
     // pre-parse arguments
     parse_debug_args(&argc, argv);
-    if (argc != 2) {
-        LOG(FATAL, "usage: %s savefile.db", argv[0]);
+    long n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    // lanes are only faster than session_work() when packed in SIMD registers
+    unsigned long n_lanes = multi_simd() ? MULTI_MAX_LANES : 1;
+    double budget = -1;
+    unsigned long lambda = 0;
+    uint64_t seed = (uint64_t) real_clock() ^ (uint64_t) getpid();
+    const char* trace_filename = NULL;
+    int lanes_set = 0;  // -j and -k do not apply to --batch
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-j") == 0 ||
+                strcmp(argv[arg], "--threads") == 0) {
+            n_threads = strtol(argv[arg+1], NULL, 0);
+            lanes_set = 1;
+        } else if (strcmp(argv[arg], "-k") == 0 ||
+                strcmp(argv[arg], "--lanes") == 0) {
+            n_lanes = strtoul(argv[arg+1], NULL, 0);
+            lanes_set = 1;
+        } else if (strcmp(argv[arg], "--spot-check") == 0) {
+            budget = strtod(argv[arg+1], NULL);
+        } else if (strcmp(argv[arg], "--batch") == 0) {
+            lambda = strtoul(argv[arg+1], NULL, 0);
+        } else if (strcmp(argv[arg], "--seed") == 0) {
+            seed = strtoull(argv[arg+1], NULL, 0);
+        } else if (strcmp(argv[arg], "--trace") == 0) {
+            trace_filename = argv[arg+1];
+        } else {
+            break;
+        }
+        arg += 2;
+    }
+    if (argc < arg + 1 || n_threads <= 0 || lambda > UINT_MAX ||
+            (lambda > 0 && (budget >= 0 || lanes_set)) || n_lanes == 0 ||
+            n_lanes > MULTI_MAX_LANES) {
+        LOG(FATAL, "usage: %s [[-j threads] [-k lanes] [--spot-check seconds] "
+            "| --batch lambda] [--seed n] [--trace trace.json] "
+            "savefile.db|checkpoints.bundle "
+            "[stream.log...]", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    const char* filename = argv[arg];
+    if (trace_filename != NULL && trace_start(trace_filename) < 0) {
+        LOG(FATAL, "failed to start tracing");
         exit(EXIT_FAILURE);
     }
 
-    // make sure sqlite3 is serialized
+    // connections are not shared between threads
     if (!sqlite3_threadsafe()) {
         LOG(FATAL, "SQLite is not threadsafe");
         exit(EXIT_FAILURE);
     }
-    sqlite3_config(SQLITE_CONFIG_SERIALIZED);
+    sqlite3_config(SQLITE_CONFIG_MULTITHREAD);
 
-    struct checkpoints_queue queue = {
-        .last_i = 0,
+    struct validation validation = {
+        .filename = filename,
+        .n_lanes = n_lanes,
+        .n_threads = (size_t) n_threads,
     };
-    mpz_init_set_ui(queue.last_w, 2);
-    pthread_mutex_init(&queue.lock, NULL);
 
-    // open sqlite3 database
-    if (sqlite3_open(argv[1], &queue.db) != SQLITE_OK) {
-        LOG(FATAL, "sqlite3_open: %s", sqlite3_errmsg(queue.db));
+    // preload checkpoints from bundle or sqlite3 database
+    validation.checkpoints = checkpoints_load(filename);
+    if (validation.checkpoints == NULL) {
+        LOG(FATAL, "failed to load %s", filename);
         exit(EXIT_FAILURE);
     }
-
-    if (sqlite3_prepare_v2(queue.db, "SELECT i, w FROM checkpoint ORDER BY i", -1,
-                           &queue.stmt_checkkpoints, NULL) != SQLITE_OK) {
-        LOG(FATAL, "sqlite3_prepare_v2: %s", sqlite3_errmsg(queue.db));
-        exit(EXIT_FAILURE);
+    if (validation.checkpoints->from_bundle) {
+        validation.filename = NULL;
     }
 
-#define N_THREADS 4
-    pthread_t threads[N_THREADS];
-    for (size_t i = 0; i < N_THREADS; i += 1) {
-        int ret = pthread_create(&threads[i], NULL, worker, &queue);
-        if (ret != 0) {
-            LOG(FATAL, "failed to start thread (%s)", strerror(ret));
+    // states logged by work split the intervals further
+    for (int k = arg + 1; k < argc; k += 1) {
+        size_t count = validation.checkpoints->count;
+        if (checkpoints_add_stream(validation.checkpoints, argv[k]) < 0) {
+            LOG(FATAL, "failed to load %s", argv[k]);
             exit(EXIT_FAILURE);
         }
+        printf("%zu checkpoints added from %s\n",
+               validation.checkpoints->count - count, argv[k]);
+    }
+    validation.results =
+        malloc(validation.checkpoints->count * sizeof(*validation.results));
+    if (validation.checkpoints->count > 0 && validation.results == NULL) {
+        LOG(FATAL, "could not allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t k = 0; k < validation.checkpoints->count; k += 1) {
+        validation.results[k] = -1;
     }
 
-    puts("Working...");
+    // the deques are written by several threads; keep them in cache lines
+    void* deques;
+    if (posix_memalign(&deques, 64,
+                       validation.n_threads * sizeof(struct deque)) != 0) {
+        LOG(FATAL, "could not allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    validation.deques = deques;
 
-    for (size_t i = 0; i < N_THREADS; i += 1) {
-        int ret = pthread_join(threads[i], NULL);
-        if (ret != 0) {
-            LOG(ERR, "failed to join thread (%s)", strerror(ret));
-        }
+    int ret;
+    if (budget >= 0) {
+        printf("Spot-check seed: %" PRIu64 "\n", seed);
+        ret = spot_check(&validation, budget, seed);
+    } else if (lambda > 0) {
+        printf("Batch seed: %" PRIu64 "\n", seed);
+        ret = validate_batches(&validation, (unsigned) lambda, seed);
+    } else {
+        ret = validate_all(&validation);
+    }
+    if (ret < 0) {
+        LOG(FATAL, "could not allocate memory");
+        exit(EXIT_FAILURE);
     }
 
     // clean up
-    sqlite3_finalize(queue.stmt_checkkpoints);
-    mpz_clear(queue.last_w);
-    pthread_mutex_destroy(&queue.lock);
+    free(validation.deques);
+    free(validation.results);
+    checkpoints_delete(validation.checkpoints);
     return EXIT_SUCCESS;
 }
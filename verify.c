@@ -0,0 +1,82 @@
+#define _POSIX_C_SOURCE 200809L
+
+// local includes
+#include "proof.h"
+#include "session.h"
+#include "store.h"
+#include "time.h"
+#include "util.h"
+
+// C99
+#include <inttypes.h>
+
+// C90
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern int main(int argc, char** argv) {
+    // parse arguments
+    parse_debug_args(&argc, argv);
+    const char* puzzle_filename = NULL;
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "--puzzle") == 0) {
+            puzzle_filename = argv[arg+1];
+        } else {
+            break;
+        }
+        arg += 2;
+    }
+    if (argc != arg + 1) {
+        LOG(FATAL, "usage: %s [--puzzle savefile.db] proof.bin", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    const char* filename = argv[arg];
+
+    // the proof is only worth something for the expected modulus: that of
+    // LCS35, or that of a test puzzle
+    struct session* session = session_new();
+    if (puzzle_filename != NULL) {
+        struct store* store = store_open_existing(puzzle_filename, 1);
+        if (store == NULL || session_parameters(session, store) < 0) {
+            LOG(FATAL, "failed to read parameters from %s", puzzle_filename);
+            exit(EXIT_FAILURE);
+        }
+        store_close(store);
+    }
+
+    struct proof* proof = proof_read(filename);
+    if (proof == NULL) {
+        LOG(FATAL, "failed to read %s", filename);
+        exit(EXIT_FAILURE);
+    }
+    if (mpz_cmp(proof->n, session->n) != 0) {
+        gmp_printf("n = %Zd\n", proof->n);
+        printf("INVALID proof: not for the modulus of %s\n",
+               puzzle_filename == NULL ? "LCS35" : puzzle_filename);
+        proof_delete(proof);
+        session_delete(session);
+        return EXIT_FAILURE;
+    }
+
+    gmp_printf("n = %Zd\nt = %#" PRIx64 " (%zu segments, %u midpoints)\n",
+               proof->n, proof->t, proof->n_segments, proof->n_rounds);
+
+    mpz_t w;
+    mpz_init(w);
+    double start = real_clock();
+    int valid = proof_verify(proof, w);
+    double elapsed = real_clock() - start;
+    if (!valid) {
+        printf("INVALID proof\n");
+    } else {
+        gmp_printf("w = 2^(2^t) mod n = %Zd\n", w);
+        printf("valid proof (checked in %.3f s)\n", elapsed);
+    }
+
+    mpz_clear(w);
+    proof_delete(proof);
+    session_delete(session);
+    return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -3,8 +3,13 @@
 // local includes
 #include "util.h"
 #include "time.h"
+#include "build.h"
+#include "duo.h"
+#include "multi.h"
 #include "session.h"
 #include "socket.h"
+#include "stream.h"
+#include "trace.h"
 
 // POSIX
 #include <unistd.h>
@@ -21,8 +26,55 @@
 #include <stdlib.h>
 #include <string.h>
 
+static int parse_work(char* buffer, struct session* session) {
+    /* Parse the response of the supervisor to resume */
+    char* str_w;
+    uint64_t i = strtoul(buffer, &str_w, 0);
+    session->i = i;
+    if (*str_w != ':') {
+        LOG(WARN, "missing colon after i in data");
+        return -1;
+    }
+    str_w += 1;
+
+    // for a test puzzle, the supervisor also sends n, c and t
+    char* str_n = strchr(str_w, ':');
+    if (str_n != NULL) {
+        *str_n = 0;
+        str_n += 1;
+        char* str_c = strchr(str_n, ':');
+        char* str_t = str_c == NULL ? NULL : strchr(str_c + 1, ':');
+        if (str_t == NULL) {
+            LOG(WARN, "incomplete puzzle parameters");
+            return -1;
+        }
+        *str_c = 0;
+        *str_t = 0;
+        if (mpz_set_str(session->n, str_n, 10) < 0 ||
+                mpz_set_str(session->c, str_c + 1, 10) < 0) {
+            LOG(WARN, "failed to parse puzzle parameters");
+            return -1;
+        }
+        session->t = strtoull(str_t + 1, NULL, 0);
+        mpz_mul(session->n_times_c, session->n, session->c);
+    }
+
+    if (mpz_set_str(session->w, str_w, 0) < 0) {
+        LOG(WARN, "missing to parse w");
+        return -1;
+    }
+    if (session_check(session) != 0) {
+        LOG(WARN, "inconsistent input from supervisor");
+        return -1;
+    }
+
+    return 0;
+}
+
 static int get_work(const char* host, const char* port, struct session* session) {
+    trace_begin("tcp_connect");
     int server = tcp_connect(host, port);
+    trace_end("tcp_connect");
     if (server < 0) {
         LOG(WARN, "failed to connect to %s:%s", host, port);
         return -1;
@@ -32,67 +84,89 @@ static int get_work(const char* host, const char* port, struct session* session)
         LOG(WARN, "failed to send command to supervisor");
         return -1;
     }
-    char buffer[1024];
-    n = read(server, buffer, sizeof(buffer) - 1);
+    // test puzzles make the response longer than a single segment, and
+    // their n, c and w grow with the size of their primes
+    char* buffer = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+    do {
+        if (capacity - size < 4096) {
+            capacity = capacity == 0 ? 4096 : 2 * capacity;
+            char* new_buffer = realloc(buffer, capacity);
+            if (new_buffer == NULL) {
+                LOG(WARN, "could not allocate memory");
+                free(buffer);
+                close(server);
+                return -1;
+            }
+            buffer = new_buffer;
+        }
+        n = read(server, buffer + size, capacity - 1 - size);
+        size += n > 0 ? (size_t) n : 0;
+    } while (n > 0);
     if (n < 0) {
         LOG(WARN, "failed to obtain response from supervisor");
+        free(buffer);
+        close(server);
         return -1;
     }
-    buffer[n] = 0;
+    buffer[size] = 0;
     LOG(DEBUG, "buffer: <%s>", buffer);
     if (close(server) < 0) {
         LOG(WARN, "failed to close connection to supervisor");
+        free(buffer);
         return -1;
     }
-
-    char* str_w;
-    uint64_t i = strtoul(buffer, &str_w, 0);
-    session->i = i;
-    if (*str_w != ':') {
-        LOG(WARN, "missing colon after i in data");
-        return -1;
-    }
-    str_w += 1;
-    if (mpz_set_str(session->w, str_w, 0) < 0) {
-        LOG(WARN, "missing to parse w");
-        return -1;
-    }
-    if (session_check(session) != 0) {
-        LOG(WARN, "inconsistent input from supervisor");
-        return -1;
-    }
-
-    return 0;
+    int ret = parse_work(buffer, session);
+    free(buffer);
+    return ret;
 }
 
-static int save_work(const char* host, const char* port, struct session* session) {
+static int save_work(const char* host, const char* port, struct session* session,
+                     const char* kernel) {
     if (session_check(session) != 0) {
         LOG(WARN, "inconsistency detected");
         return -1;
     }
 
     // prepare message
+    trace_begin("mpz_get_str");
     char* str_w = mpz_get_str(NULL, 10, session->w);
+    trace_end("mpz_get_str");
     if (str_w == NULL) {
         LOG(WARN, "failed to convert w to decimal");
         return -1;
     }
-    char buffer[1024];
-    ssize_t n = snprintf(buffer, sizeof(buffer), "save:%#"PRIx64":%s", session->i, str_w);
-    if (n < 0) {
-        LOG(WARN, "failed to prepare message");
+    // room for i and the separators besides w, kernel and build
+    size_t size = strlen(str_w) + strlen(kernel) + strlen(build_revision) + 64;
+    char* buffer = malloc(size);
+    if (buffer == NULL) {
+        LOG(WARN, "could not allocate memory");
         free(str_w);
         return -1;
     }
+    // the supervisor records which code computed w, for validate to pick
+    // another one
+    ssize_t n = snprintf(buffer, size, "save:%#"PRIx64":%s:%s:%s",
+                         session->i, str_w, kernel, build_revision);
     free(str_w);
+    if (n < 0 || (size_t) n >= size) {
+        LOG(WARN, "failed to prepare message");
+        free(buffer);
+        return -1;
+    }
 
     // send to supervisor
+    trace_begin("tcp_connect");
     int server = tcp_connect(host, port);
+    trace_end("tcp_connect");
     if (server < 0) {
         LOG(WARN, "failed to connect to %s:%s", host, port);
+        free(buffer);
         return -1;
     }
     n = write(server, buffer, (size_t) n);
+    free(buffer);
     if (n < 0) {
         LOG(WARN, "failed to send command to supervisor");
         return -1;
@@ -129,22 +203,52 @@ static void show_progress(uint64_t i, uint64_t t,
     *prev_time = now;
 }
 
-/* when SIGINT is hit, just save the current work and exit
+/* when SIGINT is hit, save the current work and exit after the current block,
+ * once it is checked and the stream has been written out
  * NOTE: the handler should be registered *after* the session is fully
  * loaded; otherwise, a badly timed SIGINT might save an empty session */
+volatile sig_atomic_t interrupted = 0;
 const char* supervisor_host;
 const char* supervisor_port;
 struct session* session = NULL;
+struct stream_writer* stream = NULL;  // records are flushed as written
+// squaring implementation selected with --kernel; session_work() if both NULL
+struct multi* multi = NULL;
+struct duo* duo = NULL;
+const char* kernel = SESSION_KERNEL;
 void handle_sigint(int sig){
     if (sig != SIGINT) {
         return;
     }
-    fprintf(stderr, "\r\33[K");  // clear line
-    if (save_work(supervisor_host, supervisor_port, session) < 0) {
-        LOG(FATAL, "failed to save work on supervisor");
-        exit(EXIT_FAILURE);
+    interrupted = 1;
+}
+
+static uint64_t work_block(void) {
+    /* session_work() on a block of 2**20 squarings, with the selected kernel
+     *
+     * w goes in and out of the kernel at each block, so that it can be
+     * checked as usual; this is cheap compared to the squarings */
+    if (multi == NULL && duo == NULL) {
+        return session_work(session, 1ull<<20);
+    }
+    uint64_t amount = session->t - session->i;
+    if (amount > 1ull<<20) {
+        amount = 1ull<<20;
+    }
+    if (amount == 0) {
+        return 0;
     }
-    exit(EXIT_SUCCESS);
+    if (multi != NULL) {
+        multi_set(multi, 0, session->w);
+        multi_work(multi, amount);
+        multi_get(multi, 0, session->w);
+    } else {
+        duo_set(duo, session->w);
+        duo_work(duo, amount);
+        duo_get(duo, session->w);
+    }
+    session->i += amount;
+    return amount;
 }
 
 extern int main(int argc, char** argv) {
@@ -154,12 +258,37 @@ extern int main(int argc, char** argv) {
 
     // parse arguments
     parse_debug_args(&argc, argv);
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s supervisor-ip port", argv[0]);
+    const char* stream_filename = NULL;
+    const char* trace_filename = NULL;
+    const char* kernel_name = "mpz_powm";
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "--log") == 0) {
+            stream_filename = argv[arg+1];
+        } else if (strcmp(argv[arg], "--trace") == 0) {
+            trace_filename = argv[arg+1];
+        } else if (strcmp(argv[arg], "--kernel") == 0) {
+            kernel_name = argv[arg+1];
+        } else {
+            break;
+        }
+        arg += 2;
+    }
+    if (argc != arg + 2 || (strcmp(kernel_name, "mpz_powm") != 0 &&
+            strcmp(kernel_name, "multi") != 0 &&
+            strcmp(kernel_name, "duo") != 0)) {
+        fprintf(stderr, "Usage: %s [--log stream.log] [--trace trace.json] "
+                "[--kernel mpz_powm|multi|duo] supervisor-ip port", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    supervisor_host = argv[arg];
+    supervisor_port = argv[arg+1];
+
+    // before any other thread is started
+    if (trace_filename != NULL && trace_start(trace_filename) < 0) {
+        LOG(FATAL, "failed to start tracing");
         exit(EXIT_FAILURE);
     }
-    supervisor_host = argv[1];
-    supervisor_port = argv[2];
 
     // display brand string
     char brand_string[49];
@@ -172,45 +301,114 @@ extern int main(int argc, char** argv) {
         exit(EXIT_FAILURE);
     }
 
+    // the modulus is only known once the supervisor has answered
+    if (strcmp(kernel_name, "multi") == 0) {
+        multi = multi_new(session->n_times_c, 1);
+        if (multi == NULL) {
+            LOG(FATAL, "could not allocate memory");
+            exit(EXIT_FAILURE);
+        }
+        kernel = multi->kernel;
+    } else if (strcmp(kernel_name, "duo") == 0) {
+        duo = duo_new(session->n_times_c);
+        if (duo == NULL) {
+            LOG(FATAL, "failed to start the duo kernel");
+            exit(EXIT_FAILURE);
+        }
+        kernel = DUO_KERNEL;
+    }
+    printf("Kernel: %s (build %s)\n", kernel, build_revision);
+
+    // every verified block is logged locally, for validate to use; records
+    // are as large as the largest w modulo n*c
+    if (stream_filename != NULL) {
+        stream = stream_create(stream_filename,
+                               mpz_sizeinbase(session->n_times_c, 256),
+                               session->n, session->c, session->t);
+        if (stream == NULL) {
+            LOG(FATAL, "failed to open %s", stream_filename);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     // register signal handler for SIGINT
     signal(SIGINT, handle_sigint);
 
+    // last i known to the supervisor
+    uint64_t saved_i = session->i;
+
     // initialize timer
     uint64_t prev_i = session->i;
     double prev_time = real_clock();
     show_progress(session->i, session->t, &prev_i, &prev_time);
 
-    while (session_work(session, 1ull<<20) != 0) {
+    while (!interrupted) {
+        trace_begin("session_work");
+        uint64_t amount = work_block();
+        trace_end("session_work");
+        if (amount == 0) {
+            break;
+        }
         fprintf(stderr, "\r\33[K");  // clear line for errors messages
 
-        if (session_check(session) != 0) {
+        trace_begin("session_check");
+        int ret = session_check(session);
+        trace_end("session_check");
+        if (ret != 0) {
             LOG(FATAL, "an error happened during computation");
             exit(EXIT_FAILURE);
         }
+        if (stream != NULL) {
+            stream_append(stream, session->i, session->w);
+        }
 
         if ((session->i >> 20) % 32 == 0) {
-            if (save_work(supervisor_host, supervisor_port, session) < 0) {
+            trace_begin("save_work");
+            ret = save_work(supervisor_host, supervisor_port, session,
+                            kernel);
+            trace_end("save_work");
+            if (ret < 0) {
                 LOG(FATAL, "failed to save work on supervisor");
                 exit(EXIT_FAILURE);
             }
+            saved_i = session->i;
         }
 
         show_progress(session->i, session->t, &prev_i, &prev_time);
     }
 
-    // one can only dream...
     fprintf(stderr, "\r\33[K");  // clear line
-    fprintf(stderr, "Calculation complete.\n");
-    mpz_mod(session->w, session->w, session->n);
-    char* str_w = mpz_get_str(NULL, 10, session->w);
-    if (str_w == NULL) {
-        LOG(FATAL, "failed to convert w to decimal");
-        exit(EXIT_FAILURE);
+    if (interrupted) {
+        if (session->i != saved_i &&
+                save_work(supervisor_host, supervisor_port, session,
+                          kernel) < 0) {
+            LOG(FATAL, "failed to save work on supervisor");
+            exit(EXIT_FAILURE);
+        }
+        fprintf(stderr, "Interrupted, work saved.\n");
+    } else {
+        // one can only dream...
+        fprintf(stderr, "Calculation complete.\n");
+        mpz_mod(session->w, session->w, session->n);
+        char* str_w = mpz_get_str(NULL, 10, session->w);
+        if (str_w == NULL) {
+            LOG(FATAL, "failed to convert w to decimal");
+            exit(EXIT_FAILURE);
+        }
+        fprintf(stderr, "w = %s\n", str_w);
+        free(str_w);
     }
-    fprintf(stderr, "w = %s\n", str_w);
-    free(str_w);
 
     // clean up
+    if (stream != NULL && stream_finish(stream) < 0) {
+        LOG(WARN, "failed to close %s", stream_filename);
+    }
+    if (multi != NULL) {
+        multi_delete(multi);
+    }
+    if (duo != NULL) {
+        duo_delete(duo);
+    }
     session_delete(session);
     return EXIT_SUCCESS;
 }